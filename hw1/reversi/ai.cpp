@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "ai.h"
+
+using namespace std;
+
+namespace {
+
+// Beyond any score
+const int INFINITE_SCORE = Searcher::WIN * 4;
+
+// Move ordering keys; a move's key is packed with its square (below 1024)
+const int PV_KEY = 1 << 20;
+const int KILLER_KEY = 1 << 19;
+const int SQUARE_BITS = 10;
+
+Bitboard::Side opponent(Bitboard::Side side)
+{
+    return side == Bitboard::WHITE ? Bitboard::BLACK : Bitboard::WHITE;
+}
+
+}
+
+/*********************** Evaluations ******************************************/
+int DiscCount::evaluate(const Bitboard& board, Bitboard::Side side) const
+{
+    return (int)board.count(side) - (int)board.count(opponent(side));
+}
+
+int Mobility::evaluate(const Bitboard& board, Bitboard::Side side) const
+{
+    return (int)board.moves(side).count() - (int)board.moves(opponent(side)).count();
+}
+
+int Corners::evaluate(const Bitboard& board, Bitboard::Side side) const
+{
+    size_t n = board.dimension();
+    const size_t corners[] = { 0, n - 1, n * (n - 1), n * n - 1 };
+    const BitPlane& own = board.discs(side);
+    const BitPlane& opp = board.discs(opponent(side));
+    int score = 0;
+    for (size_t square : corners) {
+        score += own.test(square) - opp.test(square);
+    }
+    return score;
+}
+
+int Stability::evaluate(const Bitboard& board, Bitboard::Side side) const
+{
+    return (int)board.stable(side).count() - (int)board.stable(opponent(side)).count();
+}
+
+int WeightedEvaluation::evaluate(const Bitboard& board, Bitboard::Side side) const
+{
+    int score = 0;
+    for (const pair<const Evaluation*, int>& term : terms_) {
+        score += term.second * term.first->evaluate(board, side);
+    }
+    return score;
+}
+
+const Evaluation& standard_evaluation()
+{
+    static const DiscCount discs;
+    static const Mobility mobility;
+    static const Corners corners;
+    static const Stability stability;
+    static const WeightedEvaluation standard = [] {
+        WeightedEvaluation e;
+        e.add(corners, 30);
+        e.add(stability, 15);
+        e.add(mobility, 8);
+        e.add(discs, 1);
+        return e;
+    }();
+    return standard;
+}
+
+/*********************** Search ***********************************************/
+Searcher::Searcher(const Evaluation& evaluation) :
+    evaluation_(evaluation), nodes_(0), stopped_(false), last_pv_length_(0)
+{
+}
+
+Searcher::Result Searcher::search(const Bitboard& board, Bitboard::Side side, uint64_t time_ms,
+                                  int max_depth)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Result result = { -1, 0, 0, 0, 0.0 };
+    nodes_ = 0;
+    stopped_ = false;
+    last_pv_length_ = 0;
+    for (int ply = 0; ply < MAX_PLY; ply++) {
+        killers_[ply][0] = killers_[ply][1] = -1;
+    }
+
+    BitPlane moves = board.moves(side);
+    if (!moves.any()) {
+        result.score_ = final_score(board, side);
+        return result;
+    }
+    int empty = (int)(board.dimension() * board.dimension() - board.count(Bitboard::WHITE) -
+                      board.count(Bitboard::BLACK));
+    max_depth = min(max_depth, min(empty, MAX_PLY - 1));
+
+    Bitboard work = board;
+    for (int depth = 1; depth <= max_depth; depth++) {
+        // Depth 1 always completes, so there is a move to return
+        deadline_ = depth == 1 ? chrono::steady_clock::time_point::max()
+                               : start + chrono::milliseconds(time_ms);
+        int score = negamax(work, side, depth, -INFINITE_SCORE, INFINITE_SCORE, 0);
+        if (stopped_) {
+            break;
+        }
+        result.move_ = pv_[0][0];
+        result.score_ = score;
+        result.depth_ = depth;
+        last_pv_length_ = pv_length_[0];
+        copy(pv_[0], pv_[0] + last_pv_length_, last_pv_);
+        if (abs(score) >= WIN) {
+            break;
+        }
+        // The next iteration would most likely not finish in time
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() * 2 > time_ms) {
+            break;
+        }
+    }
+    result.nodes_ = nodes_;
+    result.seconds_ = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+int Searcher::negamax(Bitboard& board, Bitboard::Side side, int depth, int alpha, int beta,
+                      int ply)
+{
+    pv_length_[ply] = ply;
+    nodes_++;
+    if ((nodes_ & 1023) == 0 && out_of_time()) {
+        stopped_ = true;
+    }
+    if (stopped_) {
+        return 0;
+    }
+
+    BitPlane moves = board.moves(side);
+    if (!moves.any()) {
+        return final_score(board, side);
+    }
+    if (depth == 0 || ply == MAX_PLY - 1) {
+        return evaluation_.evaluate(board, side);
+    }
+
+    vector<int>& ordered = moves_[ply];
+    order_moves(board, side, moves, depth, ply, ordered);
+    Bitboard::Side opp = opponent(side);
+    int best = -INFINITE_SCORE;
+    for (size_t i = 0; i < ordered.size(); i++) {
+        int square = ordered[i];
+        BitPlane flips = board.flips(square, side);
+        board.play(square, side, flips);
+        int score;
+        if (i == 0) {
+            score = -negamax(board, opp, depth - 1, -beta, -alpha, ply + 1);
+        } else {
+            // Prove the move worse than the best so far with a null
+            // window; search it fully only if that fails
+            score = -negamax(board, opp, depth - 1, -alpha - 1, -alpha, ply + 1);
+            if (score > alpha && score < beta) {
+                score = -negamax(board, opp, depth - 1, -beta, -alpha, ply + 1);
+            }
+        }
+        board.unplay(square, side, flips);
+        if (stopped_) {
+            return 0;
+        }
+        if (score > best) {
+            best = score;
+        }
+        if (score > alpha) {
+            alpha = score;
+            pv_[ply][ply] = square;
+            copy(pv_[ply + 1] + ply + 1, pv_[ply + 1] + pv_length_[ply + 1], pv_[ply] + ply + 1);
+            pv_length_[ply] = pv_length_[ply + 1];
+            if (alpha >= beta) {
+                if (killers_[ply][0] != square) {
+                    killers_[ply][1] = killers_[ply][0];
+                    killers_[ply][0] = square;
+                }
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+void Searcher::order_moves(const Bitboard& board, Bitboard::Side side, const BitPlane& moves,
+                           int depth, int ply, vector<int>& ordered) const
+{
+    int pv_move = ply < last_pv_length_ ? last_pv_[ply] : -1;
+    Bitboard::Side opp = opponent(side);
+    ordered.clear();
+    moves.for_each([&](size_t square) {
+        int key = 0;
+        if ((int)square == pv_move) {
+            key = PV_KEY;
+        } else if ((int)square == killers_[ply][0] || (int)square == killers_[ply][1]) {
+            key = KILLER_KEY;
+        } else if (depth >= 3) {
+            // Fewer replies first; only where the subtree pays for it
+            Bitboard after = board;
+            after.play(square, side, board.flips(square, side));
+            key = (1 << SQUARE_BITS) - (int)after.moves(opp).count();
+        }
+        ordered.push_back(key << SQUARE_BITS | (int)square);
+    });
+    sort(ordered.begin(), ordered.end(), greater<int>());
+    for (int& move : ordered) {
+        move &= (1 << SQUARE_BITS) - 1;
+    }
+}
+
+int Searcher::final_score(const Bitboard& board, Bitboard::Side side)
+{
+    int difference = (int)board.count(side) - (int)board.count(opponent(side));
+    if (difference > 0) {
+        return WIN + difference;
+    }
+    if (difference < 0) {
+        return -WIN + difference;
+    }
+    return 0;
+}
+
+bool Searcher::out_of_time()
+{
+    return chrono::steady_clock::now() >= deadline_;
+}
@@ -0,0 +1,131 @@
+#ifndef AI_HPP
+#define AI_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bitboard.h"
+
+/**
+ * Evaluation scores a position for the player about to move: positive
+ * is good for them. Searcher takes any Evaluation, so terms can be
+ * swapped or weighted differently without touching the search.
+ */
+class Evaluation {
+public:
+    virtual ~Evaluation() { }
+
+    /** Score of `board` for `side`; must stay well within Searcher::WIN */
+    virtual int evaluate(const Bitboard& board, Bitboard::Side side) const = 0;
+};
+
+/** Discs of `side` minus discs of the opponent */
+class DiscCount : public Evaluation {
+public:
+    int evaluate(const Bitboard& board, Bitboard::Side side) const;
+};
+
+/** Legal moves of `side` minus legal moves of the opponent */
+class Mobility : public Evaluation {
+public:
+    int evaluate(const Bitboard& board, Bitboard::Side side) const;
+};
+
+/** Corners held by `side` minus corners held by the opponent */
+class Corners : public Evaluation {
+public:
+    int evaluate(const Bitboard& board, Bitboard::Side side) const;
+};
+
+/** Stable discs (Bitboard::stable) of `side` minus the opponent's */
+class Stability : public Evaluation {
+public:
+    int evaluate(const Bitboard& board, Bitboard::Side side) const;
+};
+
+/**
+ * Weighted sum of other evaluations, which must outlive it
+ */
+class WeightedEvaluation : public Evaluation {
+public:
+    void add(const Evaluation& term, int weight) {
+        terms_.push_back(std::make_pair(&term, weight));
+    }
+
+    int evaluate(const Bitboard& board, Bitboard::Side side) const;
+
+private:
+    std::vector<std::pair<const Evaluation*, int> > terms_;
+};
+
+/**
+ * The default: corners and stability first, then mobility, then discs
+ */
+const Evaluation& standard_evaluation();
+
+/**
+ * Searcher picks moves by negamax alpha-beta search with iterative
+ * deepening and principal-variation search. Moves are tried in the
+ * order: the previous iteration's principal variation, the killer
+ * moves of the ply, then by the opponent's mobility after the move
+ * (fewest first). Moves are made and taken back on one Bitboard, with
+ * the flips as the undo record.
+ *
+ * As in Reversi::play, the game ends when the player to move has no
+ * legal move; the final score is then the disc difference.
+ */
+class Searcher {
+public:
+    /** Scores at or beyond +/-WIN are won or lost games */
+    static const int WIN = 1 << 24;
+
+    struct Result {
+        int move_;          // square to play, -1 if there is none
+        int score_;         // for the side to move, from the deepest search
+        int depth_;         // deepest search completed
+        uint64_t nodes_;    // positions visited, the unfinished search included
+        double seconds_;
+    };
+
+    explicit Searcher(const Evaluation& evaluation = standard_evaluation());
+
+    /**
+     * Searches `board` for `side` for about `time_ms` milliseconds (at
+     * least depth 1 is always completed), or to `max_depth` plies
+     */
+    Result search(const Bitboard& board, Bitboard::Side side, uint64_t time_ms,
+                  int max_depth = MAX_PLY);
+
+private:
+    static const int MAX_PLY = 64;
+
+    int negamax(Bitboard& board, Bitboard::Side side, int depth, int alpha, int beta, int ply);
+
+    /** Legal moves of `side`, in the order to try them */
+    void order_moves(const Bitboard& board, Bitboard::Side side, const BitPlane& moves,
+                     int depth, int ply, std::vector<int>& ordered) const;
+
+    /** Final score of a finished game for `side` */
+    static int final_score(const Bitboard& board, Bitboard::Side side);
+
+    bool out_of_time();
+
+    const Evaluation& evaluation_;
+    std::chrono::steady_clock::time_point deadline_;
+    uint64_t nodes_;
+    bool stopped_;              // out of time: unwind and drop this iteration
+
+    // Principal variation of the current iteration (triangular table),
+    // and of the last completed one for move ordering
+    int pv_[MAX_PLY][MAX_PLY];
+    int pv_length_[MAX_PLY];
+    int last_pv_[MAX_PLY];
+    int last_pv_length_;
+
+    int killers_[MAX_PLY][2];   // moves that last caused a cutoff at each ply
+    std::vector<int> moves_[MAX_PLY];   // move lists, kept to avoid allocating
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+
+#include "reversi.h"
+
+using namespace std;
+
+/**
+ * Benchmark of legal move generation. Plays random games on each board
+ * size, then finds every legal move of every position reached twice: by
+ * walking the eight directions square by square through the Board
+ * accessors (as Reversi did before the bitboard engine), and with
+ * Bitboard::moves(). Both must find the same moves; the output is moves
+ * generated per second for each and the speedup.
+ *
+ *   bench-reversi [--sizes 8,16,26] [--games G] [--seed N]
+ *
+ * Build: g++ -std=c++11 -O2 -o bench-reversi bench-reversi.cpp reversi.cpp
+ *        bitboard.cpp  (add -mavx2 for the vector kernels)
+ */
+
+struct Options {
+    vector<size_t> sizes_;
+    size_t games_;
+    unsigned seed_;
+
+    Options() : games_(20), seed_(1) {}
+};
+
+/** A position and the player to move */
+struct Position {
+    Board board_;
+    Square::SquareValue turn_;
+
+    Position(const Board& b, Square::SquareValue t) : board_(b), turn_(t) {}
+};
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * The square-by-square check: the row/column walk of the original
+ * Reversi::is_legal_choice
+ */
+bool scan_is_legal(const Board& board, char row, size_t column, Square::SquareValue turn)
+{
+    const size_t direction_count = 8;
+    const int direction_row[] =    {-1, -1,  0, +1, +1, +1,  0, -1};
+    const int direction_column[] = { 0, -1, -1, -1,  0, +1, +1, +1};
+
+    if (board(row, column) != Square::FREE)
+    {
+        return false;
+    }
+    for (size_t d = 0; d < direction_count; d++)
+    {
+        char cursor_row = row + direction_row[d];
+        size_t cursor_column = column + direction_column[d];
+        bool found_opposite = false;
+        while (board.is_legal_and_opposite_color(cursor_row, cursor_column, turn))
+        {
+            found_opposite = true;
+            cursor_row += direction_row[d];
+            cursor_column += direction_column[d];
+        }
+        if (found_opposite && board.is_legal_and_same_color(cursor_row, cursor_column, turn))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t scan_moves(const Board& board, Square::SquareValue turn)
+{
+    size_t moves = 0;
+    for (size_t row = 0; row < board.dimension(); row++)
+    {
+        for (size_t column = 1; column <= board.dimension(); column++)
+        {
+            moves += scan_is_legal(board, (char)('a' + row), column, turn);
+        }
+    }
+    return moves;
+}
+
+size_t bitboard_moves(const Board& board, Square::SquareValue turn)
+{
+    return board.bitboard().moves(turn == Square::BLACK ? Bitboard::BLACK : Bitboard::WHITE).count();
+}
+
+/**
+ * Plays `games` random games of side `n`, returning every position
+ * reached
+ */
+vector<Position> random_positions(size_t n, size_t games, mt19937& rng)
+{
+    vector<Position> positions;
+    for (size_t g = 0; g < games; g++)
+    {
+        Board board(n);
+        char r = n / 2 + 'a';
+        size_t c = n / 2 + 1;
+        board(r, c) = Square::BLACK;
+        board((char)(r - 1), c - 1) = Square::BLACK;
+        board((char)(r - 1), c) = Square::WHITE;
+        board(r, c - 1) = Square::WHITE;
+        Square::SquareValue turn = Square::BLACK;
+        size_t passes = 0;
+        while (passes < 2)
+        {
+            positions.push_back(Position(board, turn));
+            BitPlane moves = board.bitboard().moves(
+                turn == Square::BLACK ? Bitboard::BLACK : Bitboard::WHITE);
+            vector<size_t> squares;
+            moves.for_each([&squares](size_t square) { squares.push_back(square); });
+            if (squares.empty())
+            {
+                passes++;
+            }
+            else
+            {
+                passes = 0;
+                size_t square = squares[rng() % squares.size()];
+                board.place((char)('a' + square / n), square % n + 1, turn);
+            }
+            turn = opposite_color(turn);
+        }
+    }
+    return positions;
+}
+
+/**
+ * Calls `count` on every position until at least `min_seconds` have
+ * passed, returning moves per second
+ */
+template <typename F>
+double moves_per_second(const vector<Position>& positions, F count, double min_seconds,
+                        size_t& moves)
+{
+    size_t rounds = 0;
+    size_t total = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (const Position& p : positions)
+        {
+            total += count(p.board_, p.turn_);
+        }
+        rounds++;
+        elapsed = chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < min_seconds);
+    moves = total / rounds;
+    return total / elapsed;
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = i + 1 < argc;
+        if (ok && strcmp(argv[i], "--sizes") == 0)
+        {
+            stringstream list(argv[++i]);
+            string item;
+            while (getline(list, item, ','))
+            {
+                size_t n = strtoul(item.c_str(), NULL, 10);
+                ok = ok && n >= 4 && n <= Bitboard::MAX_DIMENSION && n % 2 == 0;
+                options.sizes_.push_back(n);
+            }
+        }
+        else if (ok && strcmp(argv[i], "--games") == 0)
+        {
+            options.games_ = strtoul(argv[++i], NULL, 10);
+        }
+        else if (ok && strcmp(argv[i], "--seed") == 0)
+        {
+            options.seed_ = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok)
+        {
+            cout << "Invalid option: " << argv[i] << endl;
+            return false;
+        }
+    }
+    if (options.sizes_.empty())
+    {
+        options.sizes_ = { 8, 16, 26 };
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        return 1;
+    }
+    mt19937 rng(options.seed_);
+    cout << "size positions moves scan_moves/s bitboard_moves/s speedup" << endl;
+    for (size_t n : options.sizes_)
+    {
+        vector<Position> positions = random_positions(n, options.games_, rng);
+        size_t scan_count = 0, bit_count = 0;
+        double scan_rate = moves_per_second(positions, scan_moves, 0.5, scan_count);
+        double bit_rate = moves_per_second(positions, bitboard_moves, 0.5, bit_count);
+        if (scan_count != bit_count)
+        {
+            cout << "Move counts differ for size " << n << ": " << scan_count << " vs "
+                 << bit_count << endl;
+            return 1;
+        }
+        cout << n << ' ' << positions.size() << ' ' << bit_count << ' ' << scan_rate << ' '
+             << bit_rate << ' ' << bit_rate / scan_rate << endl;
+    }
+    return 0;
+}
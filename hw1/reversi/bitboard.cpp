@@ -0,0 +1,443 @@
+#include <stdexcept>
+#include <vector>
+
+#include "bitboard.h"
+
+using namespace std;
+
+/**
+ * The eight directions as shifts of the row-major bit order, each with
+ * the mask that drops what wrapped around a board edge: moving east
+ * (+1) from the last column lands in the first column of the next row,
+ * so anything landing in the first column is cleared. Every mask is
+ * within the board, which also drops what went past the last row.
+ */
+struct BitGeometry {
+    enum Mask { FULL = 0, NOT_FIRST_COLUMN, NOT_LAST_COLUMN, MASKS };
+    static const size_t DIRECTIONS = 8;
+
+    unsigned shift_[DIRECTIONS];
+    bool up_[DIRECTIONS];       // toward higher bits (shl)
+    Mask mask_[DIRECTIONS];
+    BitPlane masks_[MASKS];
+    uint64_t narrow_masks_[MASKS];  // the same in one word, up to 8x8
+    size_t vectors_;            // 256-bit vectors the board needs; 0 up to 8x8
+};
+
+namespace {
+
+// The one-word overloads of bitboard.h, which the templates below would hide
+using ::any;
+using ::andnot;
+using ::shl;
+using ::shr;
+
+BitGeometry make_geometry(size_t n)
+{
+    BitGeometry g;
+    // Shifts of 0 only arise on a 1x1 board, where every mask is empty
+    unsigned side = n > 1 ? (unsigned)n : 2;
+    const unsigned shift[] = { 1, 1, side, side, side + 1, side - 1, side - 1, side + 1 };
+    const bool up[] = { true, false, true, false, true, true, false, false };
+    const BitGeometry::Mask mask[] = {
+        BitGeometry::NOT_FIRST_COLUMN, BitGeometry::NOT_LAST_COLUMN,   // E, W
+        BitGeometry::FULL, BitGeometry::FULL,                          // S, N
+        BitGeometry::NOT_FIRST_COLUMN, BitGeometry::NOT_LAST_COLUMN,   // SE, SW
+        BitGeometry::NOT_FIRST_COLUMN, BitGeometry::NOT_LAST_COLUMN    // NE, NW
+    };
+    for (size_t d = 0; d < BitGeometry::DIRECTIONS; d++) {
+        g.shift_[d] = shift[d];
+        g.up_[d] = up[d];
+        g.mask_[d] = mask[d];
+    }
+    for (size_t row = 0; row < n; row++) {
+        for (size_t column = 0; column < n; column++) {
+            size_t bit = row * n + column;
+            g.masks_[BitGeometry::FULL].set(bit);
+            if (column != 0) g.masks_[BitGeometry::NOT_FIRST_COLUMN].set(bit);
+            if (column != n - 1) g.masks_[BitGeometry::NOT_LAST_COLUMN].set(bit);
+        }
+    }
+    for (size_t m = 0; m < BitGeometry::MASKS; m++) {
+        g.narrow_masks_[m] = g.masks_[m].word(0);
+    }
+    g.vectors_ = n <= 8 ? 0 : (n * n + 255) / 256;
+    return g;
+}
+
+const BitGeometry* geometry_for(size_t dimension)
+{
+    static const vector<BitGeometry> table = [] {
+        vector<BitGeometry> t;
+        for (size_t n = 0; n <= Bitboard::MAX_DIMENSION; n++) t.push_back(make_geometry(n));
+        return t;
+    }();
+    return &table[dimension];
+}
+
+#ifdef __AVX2__
+/**
+ * The first V vectors of a BitPlane, kept in registers by the kernels.
+ * Shifts carry bits between words with a lane permute rather than
+ * through memory as BitPlane's do.
+ */
+template <size_t V>
+struct WidePlane {
+    __m256i v_[V];
+
+    WidePlane() {
+        for (size_t j = 0; j < V; j++) v_[j] = _mm256_setzero_si256();
+    }
+
+    explicit WidePlane(const BitPlane& p) {
+        for (size_t j = 0; j < V; j++) v_[j] = _mm256_loadu_si256((const __m256i*)(p.data() + 4 * j));
+    }
+
+    BitPlane plane() const {
+        BitPlane p;
+        for (size_t j = 0; j < V; j++) _mm256_storeu_si256((__m256i*)(p.data() + 4 * j), v_[j]);
+        return p;
+    }
+};
+
+template <size_t V>
+inline bool any(const WidePlane<V>& a)
+{
+    __m256i v = a.v_[0];
+    for (size_t j = 1; j < V; j++) v = _mm256_or_si256(v, a.v_[j]);
+    return !_mm256_testz_si256(v, v);
+}
+
+template <size_t V>
+inline WidePlane<V> operator&(const WidePlane<V>& a, const WidePlane<V>& b)
+{
+    WidePlane<V> r;
+    for (size_t j = 0; j < V; j++) r.v_[j] = _mm256_and_si256(a.v_[j], b.v_[j]);
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> operator|(const WidePlane<V>& a, const WidePlane<V>& b)
+{
+    WidePlane<V> r;
+    for (size_t j = 0; j < V; j++) r.v_[j] = _mm256_or_si256(a.v_[j], b.v_[j]);
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> andnot(const WidePlane<V>& a, const WidePlane<V>& b)
+{
+    WidePlane<V> r;
+    for (size_t j = 0; j < V; j++) r.v_[j] = _mm256_andnot_si256(b.v_[j], a.v_[j]);
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> shl(const WidePlane<V>& a, unsigned k)
+{
+    WidePlane<V> r;
+    __m128i up = _mm_cvtsi32_si128(k), down = _mm_cvtsi32_si128(64 - k);
+    __m256i carry = _mm256_setzero_si256();
+    for (size_t j = 0; j < V; j++) {
+        // Words rotated up one lane, the lowest taking the top word of
+        // the vector below
+        __m256i rotated = _mm256_permute4x64_epi64(a.v_[j], 0x93);
+        __m256i below = _mm256_blend_epi32(rotated, carry, 0x03);
+        r.v_[j] = _mm256_or_si256(_mm256_sll_epi64(a.v_[j], up), _mm256_srl_epi64(below, down));
+        carry = rotated;
+    }
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> shr(const WidePlane<V>& a, unsigned k)
+{
+    WidePlane<V> r;
+    __m128i down = _mm_cvtsi32_si128(k), up = _mm_cvtsi32_si128(64 - k);
+    __m256i carry = _mm256_setzero_si256();
+    for (size_t j = V; j-- > 0; ) {
+        __m256i rotated = _mm256_permute4x64_epi64(a.v_[j], 0x39);
+        __m256i above = _mm256_blend_epi32(rotated, carry, 0xC0);
+        r.v_[j] = _mm256_or_si256(_mm256_srl_epi64(a.v_[j], down), _mm256_sll_epi64(above, up));
+        carry = rotated;
+    }
+    return r;
+}
+#else
+/**
+ * The first 4V words of a BitPlane, as locals the compiler can keep in
+ * registers
+ */
+template <size_t V>
+struct WidePlane {
+    static const size_t W = 4 * V;
+    uint64_t w_[W];
+
+    WidePlane() : w_() { }
+
+    explicit WidePlane(const BitPlane& p) {
+        for (size_t i = 0; i < W; i++) w_[i] = p.word(i);
+    }
+
+    BitPlane plane() const {
+        BitPlane p;
+        for (size_t i = 0; i < W; i++) p.set_word(i, w_[i]);
+        return p;
+    }
+};
+
+template <size_t V>
+inline bool any(const WidePlane<V>& a)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < a.W; i++) v |= a.w_[i];
+    return v != 0;
+}
+
+template <size_t V>
+inline WidePlane<V> operator&(const WidePlane<V>& a, const WidePlane<V>& b)
+{
+    WidePlane<V> r;
+    for (size_t i = 0; i < a.W; i++) r.w_[i] = a.w_[i] & b.w_[i];
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> operator|(const WidePlane<V>& a, const WidePlane<V>& b)
+{
+    WidePlane<V> r;
+    for (size_t i = 0; i < a.W; i++) r.w_[i] = a.w_[i] | b.w_[i];
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> andnot(const WidePlane<V>& a, const WidePlane<V>& b)
+{
+    WidePlane<V> r;
+    for (size_t i = 0; i < a.W; i++) r.w_[i] = a.w_[i] & ~b.w_[i];
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> shl(const WidePlane<V>& a, unsigned k)
+{
+    WidePlane<V> r;
+    r.w_[0] = a.w_[0] << k;
+    for (size_t i = 1; i < a.W; i++) r.w_[i] = (a.w_[i] << k) | (a.w_[i - 1] >> (64 - k));
+    return r;
+}
+
+template <size_t V>
+inline WidePlane<V> shr(const WidePlane<V>& a, unsigned k)
+{
+    WidePlane<V> r;
+    for (size_t i = 0; i + 1 < a.W; i++) r.w_[i] = (a.w_[i] >> k) | (a.w_[i + 1] << (64 - k));
+    r.w_[a.W - 1] = a.w_[a.W - 1] >> k;
+    return r;
+}
+#endif
+
+/**
+ * Moves `x` one square in direction `d`. Plane is uint64_t for boards up
+ * to 8x8 and the smallest WidePlane that holds the board otherwise; `masks` are the geometry's masks of the
+ * same type.
+ */
+template <typename Plane>
+inline Plane step(const Plane& x, const BitGeometry& g, size_t d, const Plane* masks)
+{
+    return (g.up_[d] ? shl(x, g.shift_[d]) : shr(x, g.shift_[d])) & masks[g.mask_[d]];
+}
+
+/**
+ * Legal moves of the player owning `own`: empty squares at the end of a
+ * line of `opp` discs that starts next to an `own` disc. The lines of
+ * each direction are grown one square per iteration, all at once.
+ */
+template <typename Plane>
+Plane moves_kernel(const Plane& own, const Plane& opp, const BitGeometry& g, const Plane* masks)
+{
+    Plane empty = andnot(masks[BitGeometry::FULL], own | opp);
+    Plane moves = Plane();
+    for (size_t d = 0; d < BitGeometry::DIRECTIONS; d++) {
+        Plane run = step(own, g, d, masks) & opp;
+        while (any(run)) {
+            Plane next = step(run, g, d, masks);
+            moves = moves | (next & empty);
+            run = next & opp;
+        }
+    }
+    return moves;
+}
+
+/**
+ * Discs flipped by the owner of `own` playing the (empty) square `from`:
+ * in each direction, the line of `opp` discs next to it if an `own` disc
+ * closes it
+ */
+template <typename Plane>
+Plane flips_kernel(const Plane& from, const Plane& own, const Plane& opp, const BitGeometry& g,
+                   const Plane* masks)
+{
+    Plane flips = Plane();
+    for (size_t d = 0; d < BitGeometry::DIRECTIONS; d++) {
+        Plane run = step(from, g, d, masks) & opp;
+        Plane line = run;
+        while (any(run)) {
+            Plane next = step(run, g, d, masks);
+            if (any(next & own)) {
+                flips = flips | line;
+                break;
+            }
+            run = next & opp;
+            line = line | run;
+        }
+    }
+    return flips;
+}
+
+/**
+ * Discs of `own` that no move can flip, grown from the board edges:
+ * along each of the four lines through a disc, one of its two neighbours
+ * must be off the board or already stable
+ */
+template <typename Plane>
+Plane stable_kernel(const Plane& own, const BitGeometry& g, const Plane* masks)
+{
+    // Direction pairs of the four lines: E-W, S-N, SE-NW, SW-NE
+    const size_t line[4][2] = { { 0, 1 }, { 2, 3 }, { 4, 7 }, { 5, 6 } };
+    const Plane& full = masks[BitGeometry::FULL];
+    // Squares whose neighbour in direction d is off the board
+    Plane edge[BitGeometry::DIRECTIONS];
+    for (size_t l = 0; l < 4; l++) {
+        for (size_t k = 0; k < 2; k++) {
+            size_t d = line[l][k], back = line[l][1 - k];
+            edge[d] = andnot(full, step(full, g, back, masks));
+        }
+    }
+    Plane stable = Plane();
+    for (;;) {
+        Plane next = own;
+        for (size_t l = 0; l < 4; l++) {
+            size_t d0 = line[l][0], d1 = line[l][1];
+            next = next & (edge[d0] | step(stable, g, d1, masks) | edge[d1] |
+                           step(stable, g, d0, masks));
+        }
+        if (!any(andnot(next, stable))) return stable;
+        stable = next;
+    }
+}
+
+template <size_t V>
+BitPlane wide_moves(const BitPlane& own, const BitPlane& opp, const BitGeometry& g)
+{
+    WidePlane<V> masks[BitGeometry::MASKS];
+    for (size_t m = 0; m < BitGeometry::MASKS; m++) masks[m] = WidePlane<V>(g.masks_[m]);
+    return moves_kernel(WidePlane<V>(own), WidePlane<V>(opp), g, masks).plane();
+}
+
+template <size_t V>
+BitPlane wide_flips(size_t square, const BitPlane& own, const BitPlane& opp, const BitGeometry& g)
+{
+    WidePlane<V> masks[BitGeometry::MASKS];
+    for (size_t m = 0; m < BitGeometry::MASKS; m++) masks[m] = WidePlane<V>(g.masks_[m]);
+    BitPlane from;
+    from.set(square);
+    return flips_kernel(WidePlane<V>(from), WidePlane<V>(own), WidePlane<V>(opp), g, masks).plane();
+}
+
+template <size_t V>
+BitPlane wide_stable(const BitPlane& own, const BitGeometry& g)
+{
+    WidePlane<V> masks[BitGeometry::MASKS];
+    for (size_t m = 0; m < BitGeometry::MASKS; m++) masks[m] = WidePlane<V>(g.masks_[m]);
+    return stable_kernel(WidePlane<V>(own), g, masks).plane();
+}
+
+}
+
+Bitboard::Bitboard(size_t dimension) : dimension_(dimension)
+{
+    if (dimension > MAX_DIMENSION) {
+        throw invalid_argument("Board too large");
+    }
+    geometry_ = geometry_for(dimension);
+}
+
+BitPlane Bitboard::moves(Side side) const
+{
+    const BitPlane& own = discs_[side];
+    const BitPlane& opp = discs_[1 - side];
+    switch (geometry_->vectors_) {
+    case 0: {
+        BitPlane moves;
+        moves.set_word(0, moves_kernel(own.word(0), opp.word(0), *geometry_,
+                                       geometry_->narrow_masks_));
+        return moves;
+    }
+    case 1:
+        return wide_moves<1>(own, opp, *geometry_);
+    case 2:
+        return wide_moves<2>(own, opp, *geometry_);
+    default:
+        return wide_moves<3>(own, opp, *geometry_);
+    }
+}
+
+bool Bitboard::has_moves(Side side) const
+{
+    return moves(side).any();
+}
+
+BitPlane Bitboard::flips(size_t square, Side side) const
+{
+    const BitPlane& own = discs_[side];
+    const BitPlane& opp = discs_[1 - side];
+    if (own.test(square) || opp.test(square)) {
+        return BitPlane();
+    }
+    switch (geometry_->vectors_) {
+    case 0: {
+        BitPlane flips;
+        flips.set_word(0, flips_kernel((uint64_t)1 << square, own.word(0), opp.word(0), *geometry_,
+                                       geometry_->narrow_masks_));
+        return flips;
+    }
+    case 1:
+        return wide_flips<1>(square, own, opp, *geometry_);
+    case 2:
+        return wide_flips<2>(square, own, opp, *geometry_);
+    default:
+        return wide_flips<3>(square, own, opp, *geometry_);
+    }
+}
+
+void Bitboard::play(size_t square, Side side, const BitPlane& flips)
+{
+    discs_[side] = discs_[side] | flips;
+    discs_[1 - side] = andnot(discs_[1 - side], flips);
+    set(square, side);
+}
+
+BitPlane Bitboard::stable(Side side) const
+{
+    switch (geometry_->vectors_) {
+    case 0: {
+        BitPlane stable;
+        stable.set_word(0, stable_kernel(discs_[side].word(0), *geometry_, geometry_->narrow_masks_));
+        return stable;
+    }
+    case 1:
+        return wide_stable<1>(discs_[side], *geometry_);
+    case 2:
+        return wide_stable<2>(discs_[side], *geometry_);
+    default:
+        return wide_stable<3>(discs_[side], *geometry_);
+    }
+}
+
+void Bitboard::unplay(size_t square, Side side, const BitPlane& flips)
+{
+    clear(square);
+    discs_[side] = andnot(discs_[side], flips);
+    discs_[1 - side] = discs_[1 - side] | flips;
+}
@@ -0,0 +1,315 @@
+#ifndef BITBOARD_HPP
+#define BITBOARD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+ * BitPlane is a set of squares of a board of up to 26x26, one bit per
+ * square in row-major order (square r*dimension+c is bit r*dimension+c).
+ * The 676 bits of the largest board fill 11 words; there is room for 12
+ * so the AVX2 kernels (built with -mavx2) work on whole 256-bit vectors,
+ * and one zero guard word on each side, so a word can be shifted with
+ * the bits of its neighbour without a bounds check. Without AVX2 the same
+ * operations are plain loops.
+ */
+class BitPlane {
+public:
+    static const size_t WORDS = 12;
+
+    BitPlane() : words_() { }
+
+    /** The WORDS data words */
+    const uint64_t* data() const {
+        return words_ + 1;
+    }
+    uint64_t* data() {
+        return words_ + 1;
+    }
+
+    /** Data word `i` (bits 64*i to 64*i+63) */
+    uint64_t word(size_t i) const {
+        return words_[i + 1];
+    }
+    void set_word(size_t i, uint64_t value) {
+        words_[i + 1] = value;
+    }
+
+    bool test(size_t bit) const {
+        return (words_[bit / 64 + 1] >> (bit % 64)) & 1;
+    }
+    void set(size_t bit) {
+        words_[bit / 64 + 1] |= 1ull << (bit % 64);
+    }
+    void reset(size_t bit) {
+        words_[bit / 64 + 1] &= ~(1ull << (bit % 64));
+    }
+
+    /** True if any bit is set */
+    bool any() const;
+
+    /** Number of bits set */
+    size_t count() const;
+
+    /** Calls f(bit) for every bit set, in increasing order */
+    template <typename F>
+    void for_each(F f) const {
+        for (size_t i = 0; i < WORDS; i++) {
+            for (uint64_t w = words_[i + 1]; w != 0; w &= w - 1) {
+                f(i * 64 + __builtin_ctzll(w));
+            }
+        }
+    }
+
+    friend BitPlane operator&(const BitPlane& a, const BitPlane& b);
+    friend BitPlane operator|(const BitPlane& a, const BitPlane& b);
+    friend BitPlane operator^(const BitPlane& a, const BitPlane& b);
+    /** a & ~b */
+    friend BitPlane andnot(const BitPlane& a, const BitPlane& b);
+    /** Shifts toward higher bits by 1 to 63 */
+    friend BitPlane shl(const BitPlane& a, unsigned k);
+    /** Shifts toward lower bits by 1 to 63 */
+    friend BitPlane shr(const BitPlane& a, unsigned k);
+
+private:
+    uint64_t words_[WORDS + 2];
+};
+
+/*
+ * One-word planes for boards up to 8x8, so the kernels can be written
+ * once for both
+ */
+inline bool any(uint64_t a) {
+    return a != 0;
+}
+inline bool any(const BitPlane& a) {
+    return a.any();
+}
+inline uint64_t andnot(uint64_t a, uint64_t b) {
+    return a & ~b;
+}
+inline uint64_t shl(uint64_t a, unsigned k) {
+    return a << k;
+}
+inline uint64_t shr(uint64_t a, unsigned k) {
+    return a >> k;
+}
+
+#ifdef __AVX2__
+#define BITPLANE_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define BITPLANE_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+
+inline bool BitPlane::any() const {
+    __m256i v = _mm256_or_si256(
+        _mm256_or_si256(BITPLANE_LOAD(words_ + 1), BITPLANE_LOAD(words_ + 5)),
+        BITPLANE_LOAD(words_ + 9));
+    return !_mm256_testz_si256(v, v);
+}
+
+inline BitPlane operator&(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i += 4) {
+        BITPLANE_STORE(r.words_ + i,
+            _mm256_and_si256(BITPLANE_LOAD(a.words_ + i), BITPLANE_LOAD(b.words_ + i)));
+    }
+    return r;
+}
+
+inline BitPlane operator|(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i += 4) {
+        BITPLANE_STORE(r.words_ + i,
+            _mm256_or_si256(BITPLANE_LOAD(a.words_ + i), BITPLANE_LOAD(b.words_ + i)));
+    }
+    return r;
+}
+
+inline BitPlane operator^(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i += 4) {
+        BITPLANE_STORE(r.words_ + i,
+            _mm256_xor_si256(BITPLANE_LOAD(a.words_ + i), BITPLANE_LOAD(b.words_ + i)));
+    }
+    return r;
+}
+
+inline BitPlane andnot(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i += 4) {
+        // _mm256_andnot_si256 complements its first operand
+        BITPLANE_STORE(r.words_ + i,
+            _mm256_andnot_si256(BITPLANE_LOAD(b.words_ + i), BITPLANE_LOAD(a.words_ + i)));
+    }
+    return r;
+}
+
+inline BitPlane shl(const BitPlane& a, unsigned k) {
+    BitPlane r;
+    __m128i up = _mm_cvtsi32_si128(k), down = _mm_cvtsi32_si128(64 - k);
+    for (size_t i = 1; i <= BitPlane::WORDS; i += 4) {
+        // Each word takes the bits shifted out of the word below it
+        BITPLANE_STORE(r.words_ + i,
+            _mm256_or_si256(_mm256_sll_epi64(BITPLANE_LOAD(a.words_ + i), up),
+                            _mm256_srl_epi64(BITPLANE_LOAD(a.words_ + i - 1), down)));
+    }
+    return r;
+}
+
+inline BitPlane shr(const BitPlane& a, unsigned k) {
+    BitPlane r;
+    __m128i down = _mm_cvtsi32_si128(k), up = _mm_cvtsi32_si128(64 - k);
+    for (size_t i = 1; i <= BitPlane::WORDS; i += 4) {
+        BITPLANE_STORE(r.words_ + i,
+            _mm256_or_si256(_mm256_srl_epi64(BITPLANE_LOAD(a.words_ + i), down),
+                            _mm256_sll_epi64(BITPLANE_LOAD(a.words_ + i + 1), up)));
+    }
+    return r;
+}
+
+#undef BITPLANE_LOAD
+#undef BITPLANE_STORE
+#else
+
+inline bool BitPlane::any() const {
+    uint64_t v = 0;
+    for (size_t i = 1; i <= WORDS; i++) v |= words_[i];
+    return v != 0;
+}
+
+inline BitPlane operator&(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i++) r.words_[i] = a.words_[i] & b.words_[i];
+    return r;
+}
+
+inline BitPlane operator|(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i++) r.words_[i] = a.words_[i] | b.words_[i];
+    return r;
+}
+
+inline BitPlane operator^(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i++) r.words_[i] = a.words_[i] ^ b.words_[i];
+    return r;
+}
+
+inline BitPlane andnot(const BitPlane& a, const BitPlane& b) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i++) r.words_[i] = a.words_[i] & ~b.words_[i];
+    return r;
+}
+
+inline BitPlane shl(const BitPlane& a, unsigned k) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i++) {
+        r.words_[i] = (a.words_[i] << k) | (a.words_[i - 1] >> (64 - k));
+    }
+    return r;
+}
+
+inline BitPlane shr(const BitPlane& a, unsigned k) {
+    BitPlane r;
+    for (size_t i = 1; i <= BitPlane::WORDS; i++) {
+        r.words_[i] = (a.words_[i] >> k) | (a.words_[i + 1] << (64 - k));
+    }
+    return r;
+}
+
+#endif
+
+inline size_t BitPlane::count() const {
+    size_t n = 0;
+    for (size_t i = 1; i <= WORDS; i++) n += __builtin_popcountll(words_[i]);
+    return n;
+}
+
+/** Shift amounts and wrap masks of one board size (bitboard.cpp) */
+struct BitGeometry;
+
+/**
+ * Bitboard holds the discs of both players as bit planes and finds legal
+ * moves and flips for all eight directions at once with shift-and-mask
+ * kernels. Boards up to 8x8 are computed in a single uint64_t; larger
+ * ones in registers, on as many 256-bit vectors (or groups of four words
+ * without AVX2) as they need.
+ */
+class Bitboard {
+public:
+    /** The two players; Board maps Square::WHITE/BLACK onto these */
+    enum Side { WHITE = 0, BLACK = 1 };
+
+    static const size_t MAX_DIMENSION = 26;
+
+    /**
+     * Empty board of the given side length. Will throw
+     * std::invalid_argument if it is over MAX_DIMENSION.
+     */
+    explicit Bitboard(size_t dimension);
+
+    size_t dimension() const {
+        return dimension_;
+    }
+
+    /** Square of row and column (both from 0) */
+    size_t square(size_t row, size_t column) const {
+        return row * dimension_ + column;
+    }
+
+    const BitPlane& discs(Side side) const {
+        return discs_[side];
+    }
+
+    /** Puts a disc of `side` on `square`, replacing whatever was there */
+    void set(size_t square, Side side) {
+        discs_[side].set(square);
+        discs_[1 - side].reset(square);
+    }
+
+    /** Empties `square` */
+    void clear(size_t square) {
+        discs_[WHITE].reset(square);
+        discs_[BLACK].reset(square);
+    }
+
+    /** Every square where `side` can legally play */
+    BitPlane moves(Side side) const;
+
+    /** True if `side` has a legal move */
+    bool has_moves(Side side) const;
+
+    /**
+     * Discs that `side` would flip by playing `square`; empty if the move
+     * is not legal (including when the square is taken)
+     */
+    BitPlane flips(size_t square, Side side) const;
+
+    /** Plays `square` for `side`, flipping `flips` (as found by flips()) */
+    void play(size_t square, Side side, const BitPlane& flips);
+
+    /** Takes back play(square, side, flips) */
+    void unplay(size_t square, Side side, const BitPlane& flips);
+
+    /**
+     * Discs of `side` that can never be flipped, as grown from the
+     * corners: a disc is stable once, along each of the four lines
+     * through it, a neighbour is off the board or itself stable. This
+     * misses discs held only by full lines, so it is a lower bound.
+     */
+    BitPlane stable(Side side) const;
+
+    size_t count(Side side) const {
+        return discs_[side].count();
+    }
+
+private:
+    size_t dimension_;
+    const BitGeometry* geometry_;   // shared by all boards of this size
+    BitPlane discs_[2];
+};
+
+#endif
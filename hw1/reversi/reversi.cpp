@@ -1,11 +1,32 @@
+#include <algorithm>
 #include <vector>
 #include <stdexcept>
 #include <sstream>
+#include <type_traits>
 
 #include "reversi.h"
 
 using namespace std;
 
+namespace {
+
+Bitboard::Side to_side(Square::SquareValue value)
+{
+    return value == Square::BLACK ? Bitboard::BLACK : Bitboard::WHITE;
+}
+
+#ifdef REVERSI_PACKED_BOARD
+Square packed_square(const Bitboard& bits, size_t index)
+{
+    if (bits.discs(Bitboard::WHITE).test(index))
+    {
+        return Square::WHITE;
+    }
+    return bits.discs(Bitboard::BLACK).test(index) ? Square::BLACK : Square::FREE;
+}
+#endif
+
+}
 
 
 
@@ -56,24 +77,69 @@ Square::SquareValue opposite_color(Square::SquareValue value)
 
 
 
-Square& Board::operator()(char row, size_t column)
+#ifdef REVERSI_PACKED_BOARD
+Board::SquareRef& Board::SquareRef::operator=(Square::SquareValue value)
+{
+    if (value == Square::FREE)
+    {
+        bits_.clear(square_);
+    }
+    else
+    {
+        bits_.set(square_, to_side(value));
+    }
+    return *this;
+}
+
+Board::SquareRef::operator Square() const
+{
+    return packed_square(bits_, square_);
+}
+
+void Board::SquareRef::flip()
+{
+    Square square = *this;
+    square.flip();
+    *this = square.value_;
+}
+#endif
+
+Board::SquareRef Board::operator()(char row, size_t column)
 {
     if (!is_valid_location(row, column))
     {
         throw out_of_range("Bad row index");
     }
-    size_t row_index = row_to_index(row);
-    return squares_[row_index][column - 1];
+    size_t index = row_to_index(row) * dimension_ + column - 1;
+#ifdef REVERSI_PACKED_BOARD
+    return SquareRef(bits_, index);
+#else
+    // The caller may write through the reference
+    bits_stale_ = true;
+    return squares_[index];
+#endif
 }
 
-Square const& Board::operator()(char row, size_t column) const
+Board::ConstSquareRef Board::operator()(char row, size_t column) const
 {
     if (!is_valid_location(row, column))
     {
         throw out_of_range("Bad row index");
     }
-    size_t row_index = row_to_index(row);
-    return squares_[row_index][column - 1];
+#ifdef REVERSI_PACKED_BOARD
+    return square(row_to_index(row) * dimension_ + column - 1);
+#else
+    return squares_[row_to_index(row) * dimension_ + column - 1];
+#endif
+}
+
+Square Board::square(size_t index) const
+{
+#ifdef REVERSI_PACKED_BOARD
+    return packed_square(bits_, index);
+#else
+    return squares_[index];
+#endif
 }
 
 bool Board::is_legal_and_opposite_color(
@@ -81,8 +147,8 @@ bool Board::is_legal_and_opposite_color(
 {
     if (is_valid_location(row, column))
     {
-        size_t row_index = row_to_index(row);
-        return squares_[row_index][column - 1] != Square::FREE && squares_[row_index][column - 1] != turn;
+        Square current = square(row_to_index(row) * dimension_ + column - 1);
+        return current != Square::FREE && current != turn;
     }
     return false;
 }
@@ -92,20 +158,153 @@ bool Board::is_legal_and_same_color(
 {
     if (is_valid_location(row, column))
     {
-        size_t row_index = row_to_index(row);
-        return squares_[row_index][column - 1] == turn;
+        return square(row_to_index(row) * dimension_ + column - 1) == turn;
     }
     return false;
 }
 
+const Bitboard& Board::bitboard() const
+{
+#ifndef REVERSI_PACKED_BOARD
+    if (bits_stale_)
+    {
+        bits_ = Bitboard(dimension_);
+        for (size_t i = 0; i < dimension_ * dimension_; i++)
+        {
+            if (squares_[i] != Square::FREE)
+            {
+                bits_.set(i, to_side(squares_[i].value_));
+            }
+        }
+        bits_stale_ = false;
+    }
+#endif
+    return bits_;
+}
+
+BitPlane Board::flips(char row, size_t column, Square::SquareValue turn) const
+{
+    if (!is_valid_location(row, column))
+    {
+        throw out_of_range("Bad row index");
+    }
+    const Bitboard& bits = bitboard();
+    return bits.flips(bits.square(row_to_index(row), column - 1), to_side(turn));
+}
+
+bool Board::has_moves(Square::SquareValue turn) const
+{
+    return bitboard().has_moves(to_side(turn));
+}
+
+BitPlane Board::place(char row, size_t column, Square::SquareValue turn)
+{
+    BitPlane flipped = flips(row, column, turn);
+    apply(row, column, turn, flipped);
+    return flipped;
+}
+
+void Board::apply(char row, size_t column, Square::SquareValue turn, const BitPlane& flipped)
+{
+    size_t index = row_to_index(row) * dimension_ + column - 1;
+    // Brings bits_ up to date first
+    bitboard();
+    bits_.play(index, to_side(turn), flipped);
+#ifndef REVERSI_PACKED_BOARD
+    squares_[index] = turn;
+    flipped.for_each([this](size_t i) {
+        squares_[i].flip();
+    });
+#endif
+}
+
+void Board::take_back(char row, size_t column, Square::SquareValue turn, const BitPlane& flipped)
+{
+    size_t index = row_to_index(row) * dimension_ + column - 1;
+    bitboard();
+    bits_.unplay(index, to_side(turn), flipped);
+#ifndef REVERSI_PACKED_BOARD
+    squares_[index] = Square::FREE;
+    flipped.for_each([this](size_t i) {
+        squares_[i].flip();
+    });
+#endif
+}
+
 bool Board::is_valid_location(char row, size_t column) const
 {
     size_t row_index = row_to_index(row);
     return row_index < dimension_ && column - 1 < dimension_;
 }
 
-Checkpoint::Checkpoint(const Board& b, Square::SquareValue turn) :
-    board_(b),
+void MoveJournal::play(Board& board, char row, size_t column, Square::SquareValue turn)
+{
+    BitPlane flipped = board.place(row, column, turn);
+    // Drop the moves that could have been redone
+    if (position_ < moves_.size())
+    {
+        flips_.resize(moves_[position_].flips_);
+        moves_.resize(position_);
+    }
+    Move move;
+    move.flips_ = (uint32_t)flips_.size();
+    move.square_ = (uint16_t)((row - 'a') * board.dimension() + column - 1);
+    move.turn_ = turn;
+    moves_.push_back(move);
+    flipped.for_each([this](size_t square) {
+        flips_.push_back((uint16_t)square);
+    });
+    position_++;
+}
+
+BitPlane MoveJournal::flipped(size_t i) const
+{
+    size_t end = i + 1 < moves_.size() ? moves_[i + 1].flips_ : flips_.size();
+    BitPlane plane;
+    for (size_t f = moves_[i].flips_; f < end; f++)
+    {
+        plane.set(flips_[f]);
+    }
+    return plane;
+}
+
+Square::SquareValue MoveJournal::undo(Board& board)
+{
+    if (position_ == 0)
+    {
+        throw logic_error("No move to undo");
+    }
+    const Move& move = moves_[--position_];
+    size_t n = board.dimension();
+    board.take_back((char)('a' + move.square_ / n), move.square_ % n + 1, move.turn_,
+                    flipped(position_));
+    return move.turn_;
+}
+
+Square::SquareValue MoveJournal::redo(Board& board)
+{
+    if (position_ == moves_.size())
+    {
+        throw logic_error("No move to redo");
+    }
+    const Move& move = moves_[position_];
+    size_t n = board.dimension();
+    board.apply((char)('a' + move.square_ / n), move.square_ % n + 1, move.turn_,
+                flipped(position_));
+    position_++;
+    return move.turn_;
+}
+
+void MoveJournal::rewind(Board& board, size_t position)
+{
+    while (position_ > position)
+    {
+        undo(board);
+    }
+}
+
+Checkpoint::Checkpoint(size_t moves, Square::SquareValue turn) :
+    moves_(moves),
     turn_(turn)
 {
 
@@ -137,58 +336,26 @@ ostream& Board::print(ostream& out) const
         out << (char)('a' + i) << ':';
         for (size_t k = 0; k < dimension_; k++)
         {
-            out << squares_[i][k];
+            out << square(i * dimension_ + k);
         }
         out << endl;
     }
     return out;
 }
 
-Board::Board(size_t s) {
-    dimension_ = s;
-    squares_ = new Square*[s];
-    for(size_t i = 0 ; i < s;i++) {
-        squares_[i] = new Square[s]();
-    }
-}
-
-std::ostream &operator<<(std::ostream &out, const Board &board) {
-    return board.print(out);
+#ifdef REVERSI_PACKED_BOARD
+Board::Board(size_t s) : dimension_(s), bits_(s) {
 }
-
-Board::~Board() {
-    for(int i = 0; i < dimension_; i++) {
-        delete[] this->squares_[i];
-    }
-    delete[] squares_;
+#else
+Board::Board(size_t s) : dimension_(s), bits_stale_(false), bits_(s) {
 }
+#endif
 
-Board::Board(const Board &b) {
-    dimension_ = b.dimension_;
-    squares_ = new Square*[dimension_];
-    for(int i = 0; i < dimension_; i++) {
-        squares_[i] = new Square[dimension_]();
-        for(int j = 0; j < dimension_; j++) {
-            squares_[i][j] = b.squares_[i][j];
-        }
-    }
-}
+// Copies, checkpoints included, must stay a memcpy
+static_assert(std::is_trivially_copyable<Board>::value, "Board must be trivially copyable");
 
-Board &Board::operator=(const Board &b) {
-    if(this == &b) return *this;
-    for(int i = 0; i < dimension_; i++) {
-        delete[] this->squares_[i];
-    }
-    delete[] squares_;
-    dimension_ = b.dimension_;
-    squares_ = new Square*[dimension_];
-    for(int i = 0; i < dimension_; i++) {
-        squares_[i] = new Square[dimension_]();
-        for(int j = 0; j < dimension_; j++) {
-            squares_[i][j] = b.squares_[i][j];
-        }
-    }
-    return *this;
+std::ostream &operator<<(std::ostream &out, const Board &board) {
+    return board.print(out);
 }
 
 
@@ -219,60 +386,21 @@ void Reversi::win_loss_tie_message(size_t white_count, size_t black_count)
 
 bool Reversi::is_legal_choice(char row, size_t column, Square::SquareValue turn) const
 {
-    // Vectors for each cardinal direction
-    const size_t direction_count = 8;
-    const int direction_row[] =    {-1, -1,  0, +1, +1, +1,  0, -1};
-    const int direction_column[] = { 0, -1, -1, -1,  0, +1, +1, +1};
-
     // Make sure location is free
     if (board_(row, column) != Square::FREE)
     {
         return false;
     }
-
-    // Now check in each directions
-    for (size_t d = 0; d < direction_count; d++)
-    {
-        // Where we're checking
-        char cursor_row = row + direction_row[d];
-        size_t cursor_column = column + direction_column[d];
-
-        // Move towards the direction while we're on the opposite color
-        bool found_opposite = false;
-        while (board_.is_legal_and_opposite_color(cursor_row, cursor_column, turn_))
-        {
-            found_opposite = true;
-            cursor_row += direction_row[d];
-            cursor_column += direction_column[d];
-        }
-
-        // Check if the next thing after is our color
-        bool found_same = board_.is_legal_and_same_color(cursor_row, cursor_column, turn_);
-
-        // If this direction is valid, the move is valid, so short circuit and return
-        if (found_opposite && found_same) {
-            return true;
-        }
-    }
-    return false;
+    // Legal if it flips something in some direction
+    return board_.flips(row, column, turn).any();
 }
 
 bool Reversi::is_game_over() const
 {
-    for (unsigned char row = 'a'; row < 'a' + board_.dimension(); row++)
-    {
-        for (size_t column = 1; column <= board_.dimension(); column++)
-        {
-            if (is_legal_choice(row, column, turn_))
-            {
-                return false;
-            }
-        }
-    }
-    return true;
+    return !board_.has_moves(turn_);
 }
 
-Reversi::Reversi(size_t size) : board_(size),turn_(Square::SquareValue::BLACK) {
+Reversi::Reversi(size_t size) : board_(size),turn_(Square::SquareValue::BLACK),computer_() {
     char r = size/2 + 'a';
     int c = size/2 + 1;
     board_(r,c) = Square::SquareValue::BLACK;
@@ -284,16 +412,15 @@ Reversi::Reversi(size_t size) : board_(size),turn_(Square::SquareValue::BLACK) {
 void Reversi::play() {
     string input, temp;
     while(!is_game_over()) {
+        if(computer_[turn_]) {
+            computer_move();
+            continue;
+        }
         prompt();
         std::getline(cin,input);
         if(input == "q") {
-            size_t white = 0, black = 0;
-            for(size_t i = 0; i < board_.dimension(); i++) {
-                for(size_t j = 1; j <= board_.dimension(); j++) {
-                    if(board_((char)(i+'a'),j) == Square::WHITE) white++;
-                    else if(board_((char)(i+'a'),j) == Square::BLACK) black++;
-                }
-            }
+            size_t white = board_.bitboard().count(Bitboard::WHITE);
+            size_t black = board_.bitboard().count(Bitboard::BLACK);
             win_loss_tie_message(white,black);
             return;
         } else if(input == "c") {
@@ -314,7 +441,6 @@ void Reversi::play() {
                         col = (temp[1] - '0') * 10 + (temp[2] - '0');
                     }
                     if (is_legal_choice(row, col, turn_)) {
-                        board_(row, col) = turn_;
                         reverse(row,col,turn_);
                         turn_ = opposite_color(turn_);
                     }
@@ -322,57 +448,43 @@ void Reversi::play() {
             }
         }
     }
+    if(computer_[Square::WHITE] || computer_[Square::BLACK]) {
+        win_loss_tie_message(board_.bitboard().count(Bitboard::WHITE),
+                             board_.bitboard().count(Bitboard::BLACK));
+    }
+}
 
+void Reversi::set_computer(Square::SquareValue side, MoveChooser& chooser) {
+    computer_[side] = &chooser;
+}
+
+void Reversi::computer_move() {
+    string note;
+    size_t move = computer_[turn_]->choose(board_, turn_, note);
+    size_t n = board_.dimension();
+    char row = (char)('a' + move / n);
+    size_t col = move % n + 1;
+    cout << board_ << endl;
+    cout << (turn_ == Square::BLACK ? "B" : "W") << " plays " << row << col;
+    if(!note.empty()) cout << " (" << note << ")";
+    cout << endl;
+    reverse(row, col, turn_);
+    turn_ = opposite_color(turn_);
 }
 
 void Reversi::save_checkpoint() {
-    history_.emplace_back(board_,turn_);
+    history_.emplace_back(journal_.size(),turn_);
 }
 
 void Reversi::undo() {
     if(history_.empty()) return;
-    board_ = history_.back().board_;
+    journal_.rewind(board_, history_.back().moves_);
     turn_ = history_.back().turn_;
     history_.pop_back();
 }
 
 void Reversi::reverse(char row, size_t col, Square::SquareValue turn) {
-// Vectors for each cardinal direction
-    const size_t direction_count = 8;
-    const int direction_row[] =    {-1, -1,  0, +1, +1, +1,  0, -1};
-    const int direction_column[] = { 0, -1, -1, -1,  0, +1, +1, +1};
-
-    // Now check in each directions
-    for (size_t d = 0; d < direction_count; d++)
-    {
-        // Where we're checking
-        char cursor_row = row + direction_row[d];
-        size_t cursor_column = col + direction_column[d];
-
-        // Move towards the direction while we're on the opposite color
-        bool found_opposite = false;
-        while (board_.is_legal_and_opposite_color(cursor_row, cursor_column, turn_))
-        {
-            found_opposite = true;
-            cursor_row += direction_row[d];
-            cursor_column += direction_column[d];
-        }
-
-        // Check if the next thing after is our color
-        bool found_same = board_.is_legal_and_same_color(cursor_row, cursor_column, turn_);
-
-        // If this direction is valid, the move is valid, so short circuit and return
-        if (found_opposite && found_same) {
-            cursor_row = row + direction_row[d];
-            cursor_column = col + direction_column[d];
-            while (board_.is_legal_and_opposite_color(cursor_row, cursor_column, turn_))
-            {
-                board_(cursor_row,cursor_column) = turn_;
-                cursor_row += direction_row[d];
-                cursor_column += direction_column[d];
-            }
-        }
-    }
+    journal_.play(board_, row, col, turn);
 }
 
 
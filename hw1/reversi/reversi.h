@@ -2,8 +2,17 @@
 #define REVERSI_HPP
 
 #include <iostream>
+#include <string>
 #include <vector>
 
+#include "bitboard.h"
+
+// Board keeps its squares only in the bit planes unless built with
+// -DREVERSI_SQUARE_ARRAY (see Board)
+#if !defined(REVERSI_SQUARE_ARRAY) && !defined(REVERSI_PACKED_BOARD)
+#define REVERSI_PACKED_BOARD
+#endif
+
 /*******************************************************/
 /* Add destructors, copy constructors, and assignment  */
 /* operators to any class that requires one.           */
@@ -20,8 +29,9 @@ struct Square {
      * So Square::FREE acts as an integral constant 0,
      * Square::WHITE acts as an integral constant 1, and
      * Square::BLACK acts as an integral constant 2.
+     * A Square is stored in a single byte.
      */
-    enum SquareValue { FREE = 0, WHITE, BLACK };
+    enum SquareValue : unsigned char { FREE = 0, WHITE, BLACK };
 
     // Data member
     SquareValue value_;
@@ -77,18 +87,57 @@ Square::SquareValue opposite_color(Square::SquareValue value);
  * letters starting from 'a' to identify rows
  * and integers starting from 1 to identify
  * columns.
+ *
+ * The bit planes, 2 bits per square, are the only storage, so a Board
+ * never allocates and copying or moving one is a single memcpy of about
+ * 250 bytes at any size; operator() returns a proxy instead of a
+ * Square&. Built with -DREVERSI_SQUARE_ARRAY, the squares are also kept
+ * as a row-major Square array with room for the largest board
+ * (MAX_DIMENSION), and operator() returns a Square&; that makes a Board
+ * almost four times the size, which every copy pays even at 8x8.
  */
 class Board {
 public:
-    /*------------------- STUDENT TO WRITE -----------------*/
+#ifdef REVERSI_PACKED_BOARD
+    /**
+     * Stands in for a Square& to a packed square
+     */
+    class SquareRef {
+    public:
+        SquareRef(Bitboard& bits, size_t square) : bits_(bits), square_(square) { }
+
+        SquareRef& operator=(Square::SquareValue value);
+        operator Square() const;
+
+        bool operator==(Square::SquareValue value) const {
+            return Square(*this) == value;
+        }
+        bool operator!=(Square::SquareValue value) const {
+            return Square(*this) != value;
+        }
+
+        void flip();
+
+    private:
+        Bitboard& bits_;
+        size_t square_;
+    };
+    typedef Square ConstSquareRef;
+#else
+    typedef Square& SquareRef;
+    typedef Square const& ConstSquareRef;
+#endif
+
+    static const size_t MAX_DIMENSION = Bitboard::MAX_DIMENSION;
+
     /**
-     * Initializing constructor
+     * Initializing constructor. Will throw std::invalid_argument if the
+     * size is over MAX_DIMENSION.
      */
     Board(size_t s);
-    ~Board();
-    Board(const Board& b);
-    Board& operator=(const Board& b);
 
+    // A Board holds no pointers to its own storage, so the implicit copy
+    // and move (memcpy) are right
 
     /** Access private size as read-only. */
     size_t dimension() const {
@@ -102,8 +151,8 @@ public:
      * Will throw std::out_of_range if the row or column are
      * out of bounds.
      */
-    Square& operator()(char row, size_t column);
-    Square const& operator()(char row, size_t column) const;
+    SquareRef operator()(char row, size_t column);
+    ConstSquareRef operator()(char row, size_t column) const;
 
     /**
      * Checks if the square value at the specified row and col are legal
@@ -113,6 +162,38 @@ public:
     bool is_legal_and_opposite_color(char row, size_t column, Square::SquareValue turn) const;
     bool is_legal_and_same_color(char row, size_t column, Square::SquareValue turn) const;
 
+    /**
+     * The discs as bit planes, for finding moves. Writes through the
+     * non-const operator() are picked up by rebuilding it on the next
+     * call; place() keeps it current. (Packed boards are always current.)
+     */
+    const Bitboard& bitboard() const;
+
+    /**
+     * Discs that `turn` would flip by placing at the specified row and
+     * column; empty if that is not a legal move. Will throw
+     * std::out_of_range if the row or column are out of bounds.
+     */
+    BitPlane flips(char row, size_t column, Square::SquareValue turn) const;
+
+    /** True if `turn` has a legal move anywhere */
+    bool has_moves(Square::SquareValue turn) const;
+
+    /**
+     * Places a disc of `turn` at the specified row and column and flips
+     * the discs it captures, which it returns. Will throw
+     * std::out_of_range if the row or column are out of bounds.
+     */
+    BitPlane place(char row, size_t column, Square::SquareValue turn);
+
+    /**
+     * Places a disc of `turn` at the specified row and column and flips
+     * exactly `flipped` (as returned by flips() or place()), or takes
+     * such a move back. Neither checks the location.
+     */
+    void apply(char row, size_t column, Square::SquareValue turn, const BitPlane& flipped);
+    void take_back(char row, size_t column, Square::SquareValue turn, const BitPlane& flipped);
+
     /**
      *  Outputs the board
      */
@@ -128,7 +209,16 @@ public:
 private:
     // Our actual board representation
     size_t dimension_;  // Dimension
-    Square** squares_;  // 2D Square array
+#ifndef REVERSI_PACKED_BOARD
+    Square squares_[MAX_DIMENSION * MAX_DIMENSION];  // row-major, first dimension_^2 used
+    mutable bool bits_stale_;   // squares_ may have been written since bits_
+#endif
+    mutable Bitboard bits_;     // the squares as bit planes
+
+    /**
+     *  Private helper to read a square by its row-major index
+     */
+    Square square(size_t index) const;
 
     /**
      *  Private helper to convert 'a' to 0, 'b' to 1, etc.
@@ -145,14 +235,89 @@ private:
 
 
 /**
- * Stores a board configuration (deep copy) and the current player's turn.
+ * MoveJournal records the moves played on a Board as deltas: the square
+ * placed and the squares it flipped. Moves are taken back and replayed
+ * in O(flips), so a position is identified by the number of moves
+ * played to reach it, and search code can use play()/undo() as
+ * make/unmake. The flipped squares of all moves share one array, and a
+ * move costs a few bytes plus two per flip.
+ */
+class MoveJournal {
+public:
+    /** Moves played and not undone */
+    size_t size() const {
+        return position_;
+    }
+
+    /** Moves undone that redo() can play again */
+    size_t redo_size() const {
+        return moves_.size() - position_;
+    }
+
+    /**
+     * Places a disc of `turn` at the specified row and column of `board`
+     * (see Board::place) and records the move. Moves waiting to be
+     * redone are dropped.
+     */
+    void play(Board& board, char row, size_t column, Square::SquareValue turn);
+
+    /**
+     * Takes back the last move played, returning the player who made it
+     * (so it is their turn again). Nothing to undo is a logic_error.
+     */
+    Square::SquareValue undo(Board& board);
+
+    /**
+     * Plays the last move undone again, returning the player who made it.
+     * Nothing to redo is a logic_error.
+     */
+    Square::SquareValue redo(Board& board);
+
+    /** Undoes moves until size() is `position` (at most size()) */
+    void rewind(Board& board, size_t position);
+
+private:
+    struct Move {
+        uint32_t flips_;            // index in flips_ of its first flip
+        uint16_t square_;           // row-major index of the square placed
+        Square::SquareValue turn_;
+    };
+
+    /** The flips of move `i` as a plane */
+    BitPlane flipped(size_t i) const;
+
+    std::vector<Move> moves_;
+    std::vector<uint16_t> flips_;   // flipped squares of every move, in order
+    size_t position_ = 0;           // moves_ played; the rest were undone
+};
+
+/**
+ * MoveChooser picks the moves of a computer player. Reversi is given
+ * one per side by set_computer(), so the game itself holds no search
+ * code (see Searcher in ai.h for one).
+ */
+class MoveChooser {
+public:
+    virtual ~MoveChooser() { }
+
+    /**
+     * Returns the row-major index of a legal move for `turn` on `board`,
+     * which has at least one. May set `note` to detail printed with the
+     * move.
+     */
+    virtual size_t choose(const Board& board, Square::SquareValue turn, std::string& note) = 0;
+};
+
+/**
+ * Stores a position to go back to as the number of moves in the game's
+ * journal, and the current player's turn.
  */
 struct Checkpoint {
-    Board board_;
+    size_t moves_;
     Square::SquareValue turn_;
 
     /// Constructor
-    Checkpoint(const Board& b, Square::SquareValue t);
+    Checkpoint(size_t moves, Square::SquareValue t);
 };
 
 /**
@@ -176,6 +341,13 @@ public:
      */
     void play();
 
+    /**
+     * Lets `chooser`, which must outlive the game, pick the moves of
+     * `side` (WHITE or BLACK). When the computer plays, the game also
+     * reports the result once nobody can move.
+     */
+    void set_computer(Square::SquareValue side, MoveChooser& chooser);
+
 private:
     /**
      * Prints the board and prompt for the next input/turn.
@@ -204,7 +376,8 @@ private:
     /*------------------- STUDENT TO WRITE -----------------*/
     /**
      * Makes a checkpoint of the current board and player turn
-     * and saves it in the history vector
+     * and saves it in the history vector. The board is not copied:
+     * the checkpoint is a position in the move journal.
      */
     void save_checkpoint();
 
@@ -212,13 +385,24 @@ private:
     /**
      * Overwrites the current board and player turn with the
      *  latest saved checkpoint. If no checkpoint is available
-     *  simply return.
+     *  simply return. Takes back the moves since the checkpoint,
+     *  in O(flips) each.
      */
     void undo();
 
     /* You may add other private helper functions */
+    /**
+     * Places a disc of `turn` at the specified row and column and flips
+     * the discs it captures, recording the move in the journal
+     */
     void reverse(char row, size_t col, Square::SquareValue turn);
 
+    /**
+     * Plays the move the computer's chooser picks for `turn_`, printing
+     * it with the chooser's note
+     */
+    void computer_move();
+
 
 private:
     // You do not need to add additional data members, but
@@ -233,6 +417,13 @@ private:
 
     /// Saved checkpoints
     std::vector<Checkpoint> history_;
+
+    /// Moves played, which undo() takes back to a checkpoint
+    MoveJournal journal_;
+
+    /// Chooser of the computer's moves for each side, or NULL for a
+    /// human (indexed by SquareValue)
+    MoveChooser* computer_[3];
 };
 
 #endif
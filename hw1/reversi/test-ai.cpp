@@ -0,0 +1,107 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "ai.h"
+
+using namespace std;
+
+/**
+ * Regression test of Searcher: on positions from random 4x4 and 6x6
+ * games, the alpha-beta search (with PVS, killers and move ordering)
+ * must score the position exactly as plain minimax does at the same
+ * fixed depth and with the same evaluation, and the move it picks must
+ * reach that score. Prints each mismatch; exits with 1 if there is one.
+ *
+ *   test-ai
+ *
+ * Build: g++ -std=c++11 -O2 -o test-ai test-ai.cpp bitboard.cpp ai.cpp
+ */
+
+namespace {
+
+Bitboard::Side opponent(Bitboard::Side side)
+{
+    return side == Bitboard::WHITE ? Bitboard::BLACK : Bitboard::WHITE;
+}
+
+/** Every move searched, no pruning; the same rules as Searcher */
+int minimax(Bitboard& board, Bitboard::Side side, int depth)
+{
+    BitPlane moves = board.moves(side);
+    if (!moves.any()) {
+        int difference = (int)board.count(side) - (int)board.count(opponent(side));
+        if (difference > 0) return Searcher::WIN + difference;
+        if (difference < 0) return -Searcher::WIN + difference;
+        return 0;
+    }
+    if (depth == 0) {
+        return standard_evaluation().evaluate(board, side);
+    }
+    int best = -Searcher::WIN * 4;
+    moves.for_each([&](size_t square) {
+        BitPlane flips = board.flips(square, side);
+        board.play(square, side, flips);
+        best = max(best, -minimax(board, opponent(side), depth - 1));
+        board.unplay(square, side, flips);
+    });
+    return best;
+}
+
+Bitboard start(size_t n)
+{
+    Bitboard board(n);
+    size_t h = n / 2;
+    board.set(board.square(h - 1, h - 1), Bitboard::BLACK);
+    board.set(board.square(h, h), Bitboard::BLACK);
+    board.set(board.square(h - 1, h), Bitboard::WHITE);
+    board.set(board.square(h, h - 1), Bitboard::WHITE);
+    return board;
+}
+
+}
+
+int main()
+{
+    const struct { size_t size_; int depth_; int games_; } cases[] = {
+        { 4, 12, 20 },      // to the end of the game
+        { 6, 4, 12 },
+    };
+    mt19937 rng(1);
+    Searcher searcher;
+    size_t positions = 0, failures = 0;
+    for (const auto& c : cases) {
+        for (int game = 0; game < c.games_; game++) {
+            Bitboard board = start(c.size_);
+            Bitboard::Side side = Bitboard::BLACK;
+            for (int ply = 0; board.has_moves(side); ply++) {
+                // A win found early ends the search short of the depth
+                Searcher::Result result = searcher.search(board, side, 3600000, c.depth_);
+                Bitboard work = board;
+                int expected = minimax(work, side, result.depth_);
+                bool ok = result.score_ == expected && result.move_ >= 0 &&
+                          board.moves(side).test(result.move_);
+                if (ok) {
+                    work.play(result.move_, side, work.flips(result.move_, side));
+                    ok = -minimax(work, opponent(side), result.depth_ - 1) == expected;
+                }
+                positions++;
+                if (!ok) {
+                    failures++;
+                    cout << c.size_ << "x" << c.size_ << " game " << game << " ply " << ply
+                         << ": search " << result.score_ << " (move " << result.move_
+                         << ", depth " << result.depth_ << "), minimax " << expected << endl;
+                }
+
+                vector<size_t> moves;
+                board.moves(side).for_each([&](size_t square) { moves.push_back(square); });
+                size_t square = moves[rng() % moves.size()];
+                board.play(square, side, board.flips(square, side));
+                side = opponent(side);
+            }
+        }
+    }
+    cout << positions << " positions, " << failures << " mismatches" << endl;
+    return failures ? 1 : 0;
+}
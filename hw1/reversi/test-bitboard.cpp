@@ -0,0 +1,208 @@
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include "bitboard.h"
+
+using namespace std;
+
+/**
+ * Regression test of the Bitboard kernels against a square-by-square
+ * reference, for every board size from 4 to 26. Positions come from
+ * random games and from random fills (which reach shapes no game does,
+ * such as discs packed against every edge). In each, moves() of both
+ * sides, flips() of every square and stable() of both sides must match
+ * the reference, and no legal move may flip a disc stable() reports.
+ * Prints each mismatch; exits with 1 if there is one. Build it with and
+ * without -mavx2 to cover both the vector and the scalar kernels.
+ *
+ *   test-bitboard
+ *
+ * Build: g++ -std=c++11 -O2 -o test-bitboard test-bitboard.cpp bitboard.cpp
+ */
+
+namespace {
+
+const int DR[8] = { 0, 0, 1, -1, 1, 1, -1, -1 };
+const int DC[8] = { 1, -1, 0, 0, 1, -1, 1, -1 };
+
+/** The board as a grid: -1 empty, else the Side */
+class Reference {
+public:
+    explicit Reference(const Bitboard& board) :
+        n_((int)board.dimension()), cells_(n_ * n_, -1)
+    {
+        for (int i = 0; i < n_ * n_; i++) {
+            if (board.discs(Bitboard::WHITE).test(i)) cells_[i] = Bitboard::WHITE;
+            if (board.discs(Bitboard::BLACK).test(i)) cells_[i] = Bitboard::BLACK;
+        }
+    }
+
+    /** Walks the eight directions from the square, as Reversi once did */
+    vector<int> flips(int row, int column, int side) const
+    {
+        vector<int> flipped;
+        if (at(row, column) != -1) return flipped;
+        for (int d = 0; d < 8; d++) {
+            vector<int> run;
+            int r = row + DR[d], c = column + DC[d];
+            while (on(r, c) && at(r, c) == 1 - side) {
+                run.push_back(r * n_ + c);
+                r += DR[d];
+                c += DC[d];
+            }
+            if (!run.empty() && on(r, c) && at(r, c) == side) {
+                flipped.insert(flipped.end(), run.begin(), run.end());
+            }
+        }
+        return flipped;
+    }
+
+    /**
+     * Bitboard::stable's definition, iterated to a fixed point: along
+     * each of the four lines, a neighbour off the board or stable
+     */
+    vector<bool> stable(int side) const
+    {
+        vector<bool> stable(n_ * n_, false);
+        for (bool grew = true; grew; ) {
+            grew = false;
+            for (int r = 0; r < n_; r++) {
+                for (int c = 0; c < n_; c++) {
+                    if (at(r, c) != side || stable[r * n_ + c]) continue;
+                    bool held = true;
+                    // Direction pairs of the four lines: E-W, S-N, SE-NW, SW-NE
+                    const int lines[4][2] = { { 0, 1 }, { 2, 3 }, { 4, 7 }, { 5, 6 } };
+                    for (int l = 0; l < 4 && held; l++) {
+                        bool side_held = false;
+                        for (int k = 0; k < 2; k++) {
+                            int nr = r + DR[lines[l][k]], nc = c + DC[lines[l][k]];
+                            side_held = side_held || !on(nr, nc) || stable[nr * n_ + nc];
+                        }
+                        held = side_held;
+                    }
+                    if (held) {
+                        stable[r * n_ + c] = true;
+                        grew = true;
+                    }
+                }
+            }
+        }
+        return stable;
+    }
+
+    int at(int row, int column) const {
+        return cells_[row * n_ + column];
+    }
+
+private:
+    bool on(int row, int column) const {
+        return row >= 0 && row < n_ && column >= 0 && column < n_;
+    }
+
+    int n_;
+    vector<int> cells_;
+};
+
+size_t failures = 0;
+
+void fail(const Bitboard& board, const char* what, size_t square, int side)
+{
+    failures++;
+    if (failures > 20) return;
+    cout << board.dimension() << "x" << board.dimension() << ": " << what << " differs at square "
+         << square << " for side " << side << endl;
+}
+
+/** Compares every kernel with the reference on one position */
+void check(const Bitboard& board)
+{
+    Reference reference(board);
+    int n = (int)board.dimension();
+    for (int side = 0; side < 2; side++) {
+        Bitboard::Side s = (Bitboard::Side)side;
+        BitPlane moves = board.moves(s);
+        bool any = false;
+        for (int square = 0; square < n * n; square++) {
+            vector<int> expected = reference.flips(square / n, square % n, side);
+            BitPlane flips = board.flips(square, s);
+            bool same = flips.count() == expected.size();
+            for (int flipped : expected) {
+                same = same && flips.test(flipped);
+            }
+            if (!same) fail(board, "flips", square, side);
+            if (moves.test(square) != !expected.empty()) fail(board, "moves", square, side);
+            any = any || !expected.empty();
+        }
+        if (moves.count() > (size_t)n * n || board.has_moves(s) != any) {
+            fail(board, "has_moves", 0, side);
+        }
+
+        vector<bool> expected = reference.stable(side);
+        BitPlane stable = board.stable(s);
+        for (int square = 0; square < n * n; square++) {
+            if (stable.test(square) != expected[square]) fail(board, "stable", square, side);
+        }
+        // Stable must mean it: no move of the opponent flips one
+        board.moves((Bitboard::Side)(1 - side)).for_each([&](size_t square) {
+            BitPlane flips = board.flips(square, (Bitboard::Side)(1 - side));
+            if ((flips & stable).any()) fail(board, "stable disc flipped by", square, 1 - side);
+        });
+    }
+}
+
+Bitboard start(size_t n)
+{
+    Bitboard board(n);
+    size_t h = n / 2;
+    board.set(board.square(h - 1, h - 1), Bitboard::BLACK);
+    board.set(board.square(h, h), Bitboard::BLACK);
+    board.set(board.square(h - 1, h), Bitboard::WHITE);
+    board.set(board.square(h, h - 1), Bitboard::WHITE);
+    return board;
+}
+
+}
+
+int main()
+{
+    const int GAMES = 4, FILLS = 30;
+    mt19937 rng(1);
+    size_t positions = 0;
+    for (size_t n = 4; n <= Bitboard::MAX_DIMENSION; n++) {
+        // Positions along random games, from the start to the end
+        for (int game = 0; game < GAMES; game++) {
+            Bitboard board = start(n);
+            Bitboard::Side side = Bitboard::BLACK;
+            for (int pass = 0; pass < 2; ) {
+                if (rng() % 4 == 0 || n <= 8) {
+                    check(board);
+                    positions++;
+                }
+                // A side without a move passes; the game ends when both do
+                vector<size_t> moves;
+                board.moves(side).for_each([&](size_t square) { moves.push_back(square); });
+                if (moves.empty()) {
+                    pass++;
+                } else {
+                    pass = 0;
+                    size_t square = moves[rng() % moves.size()];
+                    board.play(square, side, board.flips(square, side));
+                }
+                side = (Bitboard::Side)(1 - side);
+            }
+        }
+        // Random fills, from sparse to full
+        for (int fill = 0; fill < FILLS; fill++) {
+            Bitboard board(n);
+            unsigned empty = rng() % 101;
+            for (size_t square = 0; square < n * n; square++) {
+                if (rng() % 100 >= empty) board.set(square, (Bitboard::Side)(rng() % 2));
+            }
+            check(board);
+            positions++;
+        }
+    }
+    cout << positions << " positions, " << failures << " mismatches" << endl;
+    return failures ? 1 : 0;
+}
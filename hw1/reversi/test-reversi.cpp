@@ -1,10 +1,38 @@
 #include <iostream>
+#include <sstream>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 
 #include "reversi.h"
+#include "ai.h"
 
 using namespace std;
 
+/**
+ * Picks the computer's moves with a Searcher, given `time_ms`
+ * milliseconds a move, and notes the depth reached and the speed
+ */
+class SearchChooser : public MoveChooser {
+public:
+    explicit SearchChooser(uint64_t time_ms) : time_ms_(time_ms) { }
+
+    size_t choose(const Board& board, Square::SquareValue turn, string& note)
+    {
+        Bitboard::Side side = turn == Square::BLACK ? Bitboard::BLACK : Bitboard::WHITE;
+        Searcher::Result result = searcher_.search(board.bitboard(), side, time_ms_);
+        ostringstream out;
+        out << "depth " << result.depth_ << ", " << result.nodes_ << " nodes, "
+            << (uint64_t)(result.nodes_ / max(result.seconds_, 1e-9)) << " nodes/s";
+        note = out.str();
+        return (size_t)result.move_;
+    }
+
+private:
+    Searcher searcher_;
+    uint64_t time_ms_;
+};
+
 
 /**
  * main - Entry point for Reversi
@@ -13,24 +41,55 @@ using namespace std;
  *  no argument is provided, default to 4.
  *  Once created, call Reversi::play() on the Reversi
  *  object and then return 0;
+ *
+ *  test-reversi [size] [--ai black|white|both] [--time ms]
+ *
+ *  --ai lets the computer play one side or both, searching
+ *  for --time milliseconds per move (default 1000).
+ *
+ *  Build: g++ -std=c++11 -O2 -o test-reversi test-reversi.cpp reversi.cpp
+ *         bitboard.cpp ai.cpp  (add -mavx2 for the vector kernels)
  */
 int main(int argc, char* argv[])
 {
     size_t size = 4;
-    if (argc >= 2)
+    const char* ai = NULL;
+    uint64_t time_ms = 1000;
+    for (int i = 1; i < argc; i++)
     {
-        size = atoi(argv[1]);
-        if( ((size % 2) == 1) ||
-                ((size < 4) || (size > 26)) ) {
-            cout << "Invalid size" << endl;
-            return 1;
+        if (strcmp(argv[i], "--ai") == 0 && i + 1 < argc)
+        {
+            ai = argv[++i];
+            if (strcmp(ai, "black") != 0 && strcmp(ai, "white") != 0 &&
+                    strcmp(ai, "both") != 0) {
+                cout << "Invalid --ai" << endl;
+                return 1;
+            }
         }
-        else {
-            size = atoi(argv[1]);
+        else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+        {
+            time_ms = strtoull(argv[++i], NULL, 10);
+        }
+        else
+        {
+            size = atoi(argv[i]);
+            if( ((size % 2) == 1) ||
+                    ((size < 4) || (size > 26)) ) {
+                cout << "Invalid size" << endl;
+                return 1;
+            }
         }
     }
     Reversi game(size);
+    SearchChooser computer(time_ms);
+    if (ai && strcmp(ai, "white") != 0)
+    {
+        game.set_computer(Square::BLACK, computer);
+    }
+    if (ai && strcmp(ai, "black") != 0)
+    {
+        game.set_computer(Square::WHITE, computer);
+    }
     game.play();
     return 0;
 }
-
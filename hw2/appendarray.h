@@ -0,0 +1,72 @@
+#ifndef APPENDARRAY_H
+#define APPENDARRAY_H
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/**
+ * Append-only array with one writer and any number of concurrent readers.
+ *
+ * Elements live in segments of doubling size (64, 128, 256, ...) that are
+ * never moved or freed while the array exists, so a reference to an
+ * element stays valid as the array grows. push_back() constructs the new
+ * element before publishing the new size with a release store; a reader
+ * that loads size() (acquire) may therefore read every element below it
+ * without locking, even while the writer appends.
+ */
+template <typename T>
+class AppendArray {
+public:
+    AppendArray() : size_(0) {
+        for (unsigned i = 0; i < SEGMENTS; i++) segments_[i] = NULL;
+    }
+
+    ~AppendArray() {
+        size_t n = size_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; i++) (*this)[i].~T();
+        for (unsigned i = 0; i < SEGMENTS; i++) ::operator delete(segments_[i]);
+    }
+
+    /** Number of published elements */
+    size_t size() const {
+        return size_.load(std::memory_order_acquire);
+    }
+
+    /** Element i; i must be below a size() the caller has loaded */
+    const T& operator[](size_t i) const {
+        size_t j = i + FIRST;
+        unsigned segment = top_bit(j) - FIRST_BITS;
+        return segments_[segment][j - (FIRST << segment)];
+    }
+
+    /** Appends an element (writer only) */
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        size_t n = size_.load(std::memory_order_relaxed);
+        size_t j = n + FIRST;
+        unsigned segment = top_bit(j) - FIRST_BITS;
+        if (!segments_[segment]) {
+            segments_[segment] = static_cast<T*>(::operator new(sizeof(T) * (FIRST << segment)));
+        }
+        new (segments_[segment] + (j - (FIRST << segment))) T(std::forward<Args>(args)...);
+        size_.store(n + 1, std::memory_order_release);
+    }
+
+private:
+    AppendArray(const AppendArray&);
+    AppendArray& operator=(const AppendArray&);
+
+    static const unsigned FIRST_BITS = 6;
+    static const size_t FIRST = size_t(1) << FIRST_BITS;
+    static const unsigned SEGMENTS = sizeof(size_t) * 8 - FIRST_BITS;
+
+    static unsigned top_bit(size_t x) {
+        return sizeof(size_t) * 8 - 1 - __builtin_clzl(x);
+    }
+
+    T* segments_[SEGMENTS];
+    std::atomic<size_t> size_;
+};
+
+#endif
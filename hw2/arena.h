@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * Append-only byte storage for many small records (commit messages and
+ * packed diffs). Records are carved out of large blocks, so each costs
+ * only its own bytes rather than a heap allocation with its header and
+ * padding. Blocks are never moved or freed while the arena exists, so
+ * pointers into it stay valid; as with AppendArray, readers may use the
+ * bytes of any record published to them while the writer allocates.
+ */
+class ByteArena {
+public:
+    ByteArena() : top_(NULL), left_(0), bytes_(0) {}
+
+    /** Returns `n` writable bytes that stay put (writer only) */
+    unsigned char* allocate(size_t n) {
+        if (n > left_) {
+            if (n > BLOCK / 4) {
+                // Large records get a block of their own, so the rest of
+                // the current block is not wasted
+                blocks_.emplace_back(new unsigned char[n]);
+                bytes_ += n;
+                return blocks_.back().get();
+            }
+            blocks_.emplace_back(new unsigned char[BLOCK]);
+            top_ = blocks_.back().get();
+            left_ = BLOCK;
+            bytes_ += BLOCK;
+        }
+        unsigned char* p = top_;
+        top_ += n;
+        left_ -= n;
+        return p;
+    }
+
+    /** Bytes held in blocks, used or not */
+    size_t bytes() const {
+        return bytes_;
+    }
+
+private:
+    ByteArena(const ByteArena&);
+    ByteArena& operator=(const ByteArena&);
+
+    static const size_t BLOCK = 64 * 1024;
+
+    std::vector<std::unique_ptr<unsigned char[]> > blocks_;
+    unsigned char* top_;    // next free byte of the current block
+    size_t left_;
+    size_t bytes_;
+};
+
+#endif
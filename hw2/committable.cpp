@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include "committable.h"
+#include "pack.h"
+
+using namespace std;
+
+CommitTable::CommitTable() : size_(0)
+{
+    attach(NULL);
+}
+
+void CommitTable::attach(std::shared_ptr<const PackFile> pack)
+{
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+    storage->base_ = pack ? pack->header().commit_count_ : 0;
+    storage->pack_ = pack;
+    if (!pack) {
+        std::string_view init = "init";
+        storage->commits_.emplace_back(storage->store(init, DiffView()), init.size(), 0,
+                                       -1, 0, 0, -1, 0, 0, FileStats());
+    }
+    std::atomic_store(&storage_, storage);
+    size_ = storage->base_ + storage->commits_.size();
+}
+
+void CommitTable::replace(const CommitTable& other)
+{
+    std::atomic_store(&storage_, other.storage_);
+    size_ = other.size_;
+}
+
+CommitTable CommitTable::freeze() const
+{
+    return CommitTable(std::atomic_load(&storage_));
+}
+
+CommitTable::CommitTable(std::shared_ptr<Storage> storage) :
+    storage_(storage), size_(storage->base_ + storage->commits_.size())
+{
+}
+
+CommitIdx CommitTable::parent(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->commit(commit).parent_;
+    return local(commit).parent_;
+}
+
+int CommitTable::depth(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->commit(commit).depth_;
+    return local(commit).depth_;
+}
+
+CommitIdx CommitTable::jump(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->commit(commit).jump_;
+    return local(commit).jump_;
+}
+
+CommitIdx CommitTable::parent2(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->commit(commit).parent2_;
+    return local(commit).parent2_;
+}
+
+int CommitTable::merges(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->commit(commit).merges_;
+    return local(commit).merges_;
+}
+
+std::string_view CommitTable::message(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->string(pack()->commit(commit).msg_);
+    return local(commit).message();
+}
+
+DiffView CommitTable::diffs(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->entry_range(pack()->commit(commit).diffs_);
+    return local(commit).diffs();
+}
+
+DiffView CommitTable::snapshot(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->entry_range(pack()->commit(commit).snapshot_);
+    return DiffView();
+}
+
+uint64_t CommitTable::hash(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return pack()->commit(commit).state_hash_;
+    return local(commit).hash_;
+}
+
+FileStats CommitTable::stats(CommitIdx commit) const
+{
+    if (commit < storage_->base_) {
+        const PackCommit& record = pack()->commit(commit);
+        FileStats stats;
+        stats.sum_ = record.sum_;
+        stats.count_ = record.file_count_;
+        stats.min_ = record.min_;
+        stats.max_ = record.max_;
+        return stats;
+    }
+    return local(commit).stats_;
+}
+
+const FileTree* CommitTable::state(CommitIdx commit) const
+{
+    if (commit < storage_->base_) return NULL;
+    return local(commit).state_.get();
+}
+
+CommitIdx CommitTable::append(std::string_view msg, DiffView diffs, CommitIdx parent, int depth,
+                              uint64_t hash, const FileStats& stats, CommitIdx parent2,
+                              const FileTree* state)
+{
+    CommitObj commit(storage_->store(msg, diffs), msg.size(), diffs.size(), parent, depth,
+                     jump_for(parent), parent2, merges(parent) + (parent2 >= 0), hash, stats);
+    if (state) commit.state_.reset(new FileTree(*state));
+    storage_->commits_.emplace_back(std::move(commit));
+    return size_++;
+}
+
+size_t CommitTable::bytes() const
+{
+    return storage_->commits_.size() * sizeof(CommitObj) + storage_->arena_.bytes();
+}
+
+size_t CommitTable::encoded_bytes() const
+{
+    std::vector<unsigned char> packed;
+    size_t total = 0;
+    for (CommitIdx commit = 0; commit < size(); commit++) {
+        packed.clear();
+        encode_files(diffs(commit), packed);
+        total += message(commit).size() + packed.size();
+    }
+    return total;
+}
+
+const unsigned char* CommitTable::Storage::store(std::string_view msg, DiffView diffs)
+{
+    scratch_.clear();
+    encode_files(diffs, scratch_);
+    unsigned char* data = arena_.allocate(msg.size() + scratch_.size());
+    memcpy(data, msg.data(), msg.size());
+    if (!scratch_.empty()) memcpy(data + msg.size(), scratch_.data(), scratch_.size());
+    return data;
+}
+
+CommitIdx CommitTable::jump_for(CommitIdx parent) const
+{
+    CommitIdx j = jump(parent);
+    CommitIdx jj = jump(j);
+    if (depth(parent) - depth(j) == depth(j) - depth(jj)) return jj;
+    return parent;
+}
+
+CommitIdx CommitTable::ancestor_at(CommitIdx commit, int target) const
+{
+    // Jumps never land above the target's depth, so each commit on the
+    // way is visited at most once and there are O(log depth) of them
+    while (commit > 0 && depth(commit) > target) {
+        CommitIdx j = jump(commit);
+        commit = depth(j) >= target ? j : parent(commit);
+    }
+    return commit;
+}
+
+CommitIdx CommitTable::kth_ancestor(CommitIdx commit, int k) const
+{
+    return ancestor_at(commit, max(0, depth(commit) - k));
+}
+
+bool CommitTable::is_ancestor(CommitIdx ancestor, CommitIdx commit) const
+{
+    return depth(ancestor) <= depth(commit) && ancestor_at(commit, depth(ancestor)) == ancestor;
+}
+
+CommitIdx CommitTable::lca(CommitIdx a, CommitIdx b) const
+{
+    if (depth(a) > depth(b)) a = ancestor_at(a, depth(b));
+    else b = ancestor_at(b, depth(a));
+    // Jump targets depend only on depth, so at equal depths both sides
+    // jump together; jump while that stays below the meeting point
+    while (a != b && a > 0 && b > 0) {
+        if (jump(a) != jump(b)) {
+            a = jump(a);
+            b = jump(b);
+        } else {
+            a = parent(a);
+            b = parent(b);
+        }
+    }
+    return a == b ? a : 0;
+}
+
+CommitIdx CommitTable::split(CommitIdx a, CommitIdx b,
+                             std::vector<CommitIdx>* only_a, std::vector<CommitIdx>* only_b) const
+{
+    CommitIdx base = lca(a, b);
+    if (merges(a) == merges(base) && merges(b) == merges(base)) {
+        // Both histories are plain chains down to base
+        for (CommitIdx i = a; only_a && i != base; i = parent(i)) only_a->push_back(i);
+        for (CommitIdx i = b; only_b && i != base; i = parent(i)) only_b->push_back(i);
+        return base;
+    }
+
+    enum { FROM_A = 1, FROM_B = 2, FROM_BOTH = 3 };
+    std::unordered_map<CommitIdx, unsigned char> flags;
+    std::priority_queue<CommitIdx> queue;
+    size_t pending = 0;         // queued commits not yet reachable from both
+    base = -1;
+    flags[a] |= FROM_A;
+    flags[b] |= FROM_B;
+    queue.push(a);
+    if (b != a) queue.push(b);
+    pending = flags[a] == FROM_BOTH ? 0 : queue.size();
+
+    while (pending > 0) {
+        // Children come after their parents, so once a commit is on top
+        // every path to it has been seen and its flags are final
+        CommitIdx commit = queue.top();
+        queue.pop();
+        unsigned char f = flags[commit];
+        if (f == FROM_BOTH) {
+            if (base < 0) base = commit;
+        } else {
+            pending--;
+            if (f == FROM_A && only_a) only_a->push_back(commit);
+            if (f == FROM_B && only_b) only_b->push_back(commit);
+        }
+        const CommitIdx parents[2] = { parent(commit), parent2(commit) };
+        for (CommitIdx p : parents) {
+            if (p < 0) continue;
+            std::unordered_map<CommitIdx, unsigned char>::iterator it = flags.find(p);
+            if (it == flags.end()) {
+                flags[p] = f;
+                queue.push(p);
+                if (f != FROM_BOTH) pending++;
+            } else if ((it->second | f) != it->second) {
+                if (it->second != FROM_BOTH && (it->second | f) == FROM_BOTH) pending--;
+                it->second |= f;
+            }
+        }
+    }
+    // Everything still queued is common; the newest of it cannot be an
+    // ancestor of any other common commit
+    if (base < 0) base = queue.empty() ? 0 : queue.top();
+    return base;
+}
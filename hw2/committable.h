@@ -0,0 +1,239 @@
+#ifndef COMMITTABLE_H
+#define COMMITTABLE_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include "filestate.h"
+#include "filetree.h"
+#include "filestats.h"
+#include "appendarray.h"
+#include "arena.h"
+
+class PackFile;
+
+/**
+ * Integral type used to index Commits
+ */
+typedef int CommitIdx;
+
+/**
+ * Container for data pertaining to each commit. The message and the
+ * packed diffs (see encode_files()) sit back to back in the commit
+ * table's arena; the record itself is fixed-size.
+ */
+struct CommitObj {
+    // Message, then diffs: interned filenames (sorted by id) and the
+    // integer *difference* of each file from the parent commit
+    const unsigned char* data_;
+    // FileTree::hash() of the commit's full state
+    uint64_t hash_;
+    // Aggregates of the file values in the commit's full state
+    FileStats stats_;
+    // Full state published for concurrent readers, NULL for most commits
+    std::unique_ptr<const FileTree> state_;
+    uint32_t msg_size_;
+    uint32_t diff_count_;
+    CommitIdx parent_;
+    // Number of commits between this one and "init" (init has depth 0)
+    int depth_;
+    // Skip pointer: an ancestor chosen so that any ancestor can be
+    // reached in O(log depth) steps (see CommitTable::jump_for)
+    CommitIdx jump_;
+    // Second parent of a merge commit, -1 otherwise. parent_, depth_
+    // and jump_ always follow the first parent.
+    CommitIdx parent2_;
+    // Merge commits on the first-parent chain up to and including this one
+    int merges_;
+
+    CommitObj(
+        const unsigned char* data,
+        uint32_t msg_size,
+        uint32_t diff_count,
+        CommitIdx parent,
+        int depth,
+        CommitIdx jump,
+        CommitIdx parent2,
+        int merges,
+        uint64_t hash,
+        const FileStats& stats) :
+        data_(data), hash_(hash), stats_(stats), msg_size_(msg_size), diff_count_(diff_count),
+        parent_(parent), depth_(depth), jump_(jump), parent2_(parent2), merges_(merges)
+    {}
+
+    std::string_view message() const {
+        return std::string_view(reinterpret_cast<const char*>(data_), msg_size_);
+    }
+
+    DiffView diffs() const {
+        return DiffView(data_ + msg_size_, diff_count_);
+    }
+};
+
+/**
+ * All commits of a repository, indexed by CommitIdx. Commits loaded from
+ * a pack are read straight from the mapped file; commits made since are
+ * held as CommitObj records after them.
+ *
+ * Committed history is immutable and only ever appended to, so a copy of
+ * a CommitTable is a cheap, consistent snapshot: it shares the storage
+ * but sees only the commits that existed when it was taken. freeze()
+ * may be called from other threads while the owner appends; readers
+ * never take a lock. attach() does not disturb existing snapshots, which
+ * keep the old storage (and pack) alive until the last one is dropped.
+ */
+class CommitTable {
+public:
+    CommitTable();
+
+    /**
+     * Replaces all commits with those of the given pack, or with just
+     * "init" if pack is NULL
+     */
+    void attach(std::shared_ptr<const PackFile> pack);
+
+    /**
+     * Replaces all commits with those of `other`, a table the caller has
+     * built (e.g. a compacted copy). Like attach(), it leaves existing
+     * snapshots on the old commits.
+     */
+    void replace(const CommitTable& other);
+
+    /**
+     * Returns a read-only copy frozen at the current size. Safe to call
+     * concurrently with append(), attach() and replace() on this table.
+     */
+    CommitTable freeze() const;
+
+    /** Number of commits, including "init" */
+    CommitIdx size() const {
+        return size_;
+    }
+
+    /** True if both tables are views of the same history */
+    bool same_history(const CommitTable& other) const {
+        return storage_ == other.storage_;
+    }
+
+    /** Pack the commits were loaded from, NULL if none */
+    const PackFile* pack() const {
+        return storage_->pack_.get();
+    }
+
+    CommitIdx parent(CommitIdx commit) const;
+    int depth(CommitIdx commit) const;
+    CommitIdx jump(CommitIdx commit) const;
+    CommitIdx parent2(CommitIdx commit) const;
+    int merges(CommitIdx commit) const;
+    std::string_view message(CommitIdx commit) const;
+    DiffView diffs(CommitIdx commit) const;
+
+    /**
+     * FileTree::hash() of the commit's full state; commits with equal
+     * hashes have the same files (up to a 2^-64 chance)
+     */
+    uint64_t hash(CommitIdx commit) const;
+
+    /** Aggregates of the file values in the commit's full state, O(1) */
+    FileStats stats(CommitIdx commit) const;
+
+    /**
+     * Full state stored for the commit in the pack, empty if none
+     */
+    DiffView snapshot(CommitIdx commit) const;
+
+    /**
+     * Full state published with the commit by append(), NULL if none
+     */
+    const FileTree* state(CommitIdx commit) const;
+
+    /**
+     * Adds a commit and returns its index. `diffs` are relative to
+     * `parent`; `hash` and `stats` summarize the resulting state;
+     * `parent2` is the merged-in commit of a merge, else -1.
+     * If `state` is given, the commit's full state is kept with it so
+     * that readers of snapshots need not replay history to get there;
+     * the tree shares its nodes with the caller's copy.
+     */
+    CommitIdx append(std::string_view msg, DiffView diffs, CommitIdx parent, int depth,
+                     uint64_t hash, const FileStats& stats, CommitIdx parent2 = -1,
+                     const FileTree* state = NULL);
+
+    /**
+     * Memory held for commits added by append(): records, messages and
+     * diffs (published states and the mapped pack are not counted)
+     */
+    size_t bytes() const;
+
+    /**
+     * Bytes of every commit's message and packed diff (encode_files()),
+     * wherever they are stored: unlike bytes(), a function of the history
+     * alone, with no block slack
+     */
+    size_t encoded_bytes() const;
+
+    /**
+     * Ancestor queries over the parent links. The skip pointers follow
+     * the skew-binary scheme (Myers, "An applicative random-access
+     * stack"): a commit jumps to its parent's jump's jump when the two
+     * spans below it are equal, else to its parent. Every query takes
+     * O(log depth) steps and each commit stores a single extra index.
+     */
+
+    /** The ancestor of `commit` at the given depth ("init" at depth 0) */
+    CommitIdx ancestor_at(CommitIdx commit, int depth) const;
+
+    /** The k-th ancestor of `commit`, or "init" if k reaches past it */
+    CommitIdx kth_ancestor(CommitIdx commit, int k) const;
+
+    /** True if `ancestor` is `commit` or one of its ancestors */
+    bool is_ancestor(CommitIdx ancestor, CommitIdx commit) const;
+
+    /** Lowest common ancestor of two commits along first parents */
+    CommitIdx lca(CommitIdx a, CommitIdx b) const;
+
+    /**
+     * Separates the histories of two commits, following both parents of
+     * merges: fills `only_a` and `only_b` (either may be NULL) with the
+     * commits reachable from one but not the other, newest first, and
+     * returns a best common ancestor (one that no other common ancestor
+     * descends from).
+     *
+     * Without merges between the commits and their first-parent LCA this
+     * walks just the two paths down to it. Otherwise it walks both
+     * histories in index order (parents always precede their children)
+     * until every pending commit is reachable from both.
+     */
+    CommitIdx split(CommitIdx a, CommitIdx b,
+                    std::vector<CommitIdx>* only_a, std::vector<CommitIdx>* only_b) const;
+
+private:
+    /** Skip pointer for a new child of `parent` */
+    CommitIdx jump_for(CommitIdx parent) const;
+
+    /**
+     * Commits shared by a table and its snapshots
+     */
+    struct Storage {
+        std::shared_ptr<const PackFile> pack_;
+        CommitIdx base_;            // commits stored in the pack
+        AppendArray<CommitObj> commits_;
+        ByteArena arena_;           // messages and packed diffs
+        std::vector<unsigned char> scratch_;
+
+        /** Copies a message and the packed diffs into the arena */
+        const unsigned char* store(std::string_view msg, DiffView diffs);
+    };
+
+    const CommitObj& local(CommitIdx commit) const {
+        return storage_->commits_[commit - storage_->base_];
+    }
+
+    explicit CommitTable(std::shared_ptr<Storage> storage);
+
+    // Replaced by attach(); read with std::atomic_load by freeze()
+    std::shared_ptr<Storage> storage_;
+    CommitIdx size_;
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include "filestate.h"
+#include "pack.h"
+
+using namespace std;
+
+NameTable::HashIndex::HashIndex(uint64_t slots) :
+    mask_(slots - 1), slots_(new std::atomic<NameId>[slots])
+{
+    for (uint64_t i = 0; i < slots; i++) {
+        slots_[i].store(NameTable::NO_NAME, memory_order_relaxed);
+    }
+}
+
+void NameTable::HashIndex::insert(NameId id, std::string_view name)
+{
+    uint64_t slot = pack_hash(name) & mask_;
+    while (slots_[slot].load(memory_order_relaxed) != NO_NAME) {
+        slot = (slot + 1) & mask_;
+    }
+    // Release: a reader that sees the id also sees the name behind it
+    slots_[slot].store(id, memory_order_release);
+}
+
+NameTable::NameTable() : size_(0)
+{
+    attach(NULL);
+}
+
+NameTable::NameTable(std::shared_ptr<Storage> storage) :
+    storage_(storage), size_(storage->base_count_ + storage->names_.size())
+{
+}
+
+void NameTable::attach(std::shared_ptr<const PackFile> pack)
+{
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+    storage->pack_ = pack;
+    storage->base_count_ = pack ? pack->header().name_count_ : 0;
+    std::atomic_store(&storage_, storage);
+    size_ = storage->base_count_;
+}
+
+NameTable NameTable::freeze() const
+{
+    return NameTable(std::atomic_load(&storage_));
+}
+
+NameId NameTable::intern(std::string_view name)
+{
+    NameId id = find(name);
+    if (id != NO_NAME) return id;
+    Storage& s = *storage_;
+    id = size_;
+    s.strings_.emplace_back(name);
+    s.names_.emplace_back(s.strings_.back());
+    size_++;
+
+    // Keep the index at most half full, growing it by doubling
+    size_t count = s.names_.size();
+    const HashIndex* index = s.index_.load(memory_order_relaxed);
+    if (!index || count * 2 > index->mask_ + 1) {
+        uint64_t slots = index ? (index->mask_ + 1) * 2 : 64;
+        s.indexes_.emplace_back(new HashIndex(slots));
+        HashIndex* grown = s.indexes_.back().get();
+        for (size_t i = 0; i < count; i++) {
+            grown->insert(s.base_count_ + i, s.names_[i]);
+        }
+        s.index_.store(grown, memory_order_release);
+    } else {
+        s.indexes_.back()->insert(id, s.names_[count - 1]);
+    }
+    return id;
+}
+
+NameId NameTable::find(std::string_view name) const
+{
+    const Storage& s = *storage_;
+    if (s.pack_ && s.base_count_ > 0) {
+        // Probe the pack's open-addressing index
+        const uint32_t* hash = s.pack_->name_hash();
+        uint64_t mask = s.pack_->header().hash_slots_ - 1;
+        uint64_t slot = pack_hash(name) & mask;
+        for (uint64_t probes = 0; probes <= mask && hash[slot] != NO_NAME; probes++) {
+            if (hash[slot] < s.base_count_ && this->name(hash[slot]) == name) {
+                return hash[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    const HashIndex* index = s.index_.load(memory_order_acquire);
+    if (!index) return NO_NAME;
+    uint64_t slot = pack_hash(name) & index->mask_;
+    NameId id;
+    while ((id = index->slots_[slot].load(memory_order_acquire)) != NO_NAME) {
+        // Names interned after this table was frozen do not exist for it
+        if (id < size_ && this->name(id) == name) return id;
+        slot = (slot + 1) & index->mask_;
+    }
+    return NO_NAME;
+}
+
+std::string_view NameTable::name(NameId id) const
+{
+    if (id < storage_->base_count_) {
+        return storage_->pack_->string(storage_->pack_->names()[id]);
+    }
+    return storage_->names_[id - storage_->base_count_];
+}
+
+void write_files(std::ostream& out, const NameTable& names, DiffView files)
+{
+    // Entries are ordered by id; output is ordered by filename. Each
+    // name is looked up once rather than on every comparison.
+    typedef std::pair<std::string_view, int> Named;
+    std::vector<Named> sorted;
+    sorted.reserve(files.size());
+    for (DiffView::const_iterator cit = files.begin(); cit != files.end(); ++cit) {
+        sorted.push_back(Named(names.name(cit->name_), cit->value_));
+    }
+    std::sort(sorted.begin(), sorted.end(),
+        [](const Named& a, const Named& b) {
+            return a.first < b.first;
+        });
+    for (size_t i = 0; i < sorted.size(); i++) {
+        out << sorted[i].first << " : " << sorted[i].second << '\n';
+    }
+}
+
+namespace {
+
+void write_varint(uint32_t x, std::vector<unsigned char>& out)
+{
+    while (x >= 0x80) {
+        out.push_back((unsigned char)(x | 0x80));
+        x >>= 7;
+    }
+    out.push_back((unsigned char)x);
+}
+
+}
+
+void encode_files(DiffView files, std::vector<unsigned char>& out)
+{
+    NameId previous = 0;
+    for (DiffView::const_iterator it = files.begin(); it != files.end(); ++it) {
+        write_varint(it->name_ - previous, out);
+        write_varint(((uint32_t)it->value_ << 1) ^ (uint32_t)(it->value_ >> 31), out);
+        previous = it->name_;
+    }
+}
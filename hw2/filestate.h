@@ -0,0 +1,250 @@
+#ifndef FILESTATE_H
+#define FILESTATE_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include "appendarray.h"
+
+class PackFile;
+
+/**
+ * Dense integer handle for an interned filename
+ */
+typedef uint32_t NameId;
+
+/**
+ * Repository-wide filename interner. Each distinct filename is stored
+ * once and mapped to a dense NameId (0, 1, 2, ...) in first-seen order.
+ *
+ * Names loaded from a pack stay in the mapped file and are looked up
+ * through its on-disk index; only names added afterwards live in memory.
+ *
+ * Like CommitTable, names are append-only: freeze() returns a copy that
+ * sees the names interned so far and can be used from another thread
+ * while the owner keeps interning. Lookups never take a lock.
+ */
+class NameTable {
+public:
+    /**
+     * Id returned by find() for names that were never interned
+     */
+    static constexpr NameId NO_NAME = 0xffffffffu;
+
+    NameTable();
+
+    /**
+     * Replaces all names with those of the given pack, or with none if
+     * pack is NULL
+     */
+    void attach(std::shared_ptr<const PackFile> pack);
+
+    /**
+     * Returns a read-only copy frozen at the current size. Safe to call
+     * concurrently with intern() and attach() on this table.
+     */
+    NameTable freeze() const;
+
+    /**
+     * Returns the id of the given name, interning it if needed
+     */
+    NameId intern(std::string_view name);
+
+    /**
+     * Returns the id of the given name or NO_NAME if unknown
+     */
+    NameId find(std::string_view name) const;
+
+    /**
+     * Returns the filename for a previously interned id
+     */
+    std::string_view name(NameId id) const;
+
+    /** Number of interned names */
+    size_t size() const {
+        return size_;
+    }
+
+    /** Pack the names were loaded from, NULL if none */
+    const PackFile* pack() const {
+        return storage_->pack_.get();
+    }
+
+private:
+    /**
+     * Open-addressing hash index over the in-memory names. Slots are
+     * filled once and never cleared; a full index is replaced by a
+     * larger copy, and the old one is kept until the storage goes away
+     * since readers may still be probing it.
+     */
+    struct HashIndex {
+        uint64_t mask_;
+        std::unique_ptr<std::atomic<NameId>[]> slots_;
+
+        explicit HashIndex(uint64_t slots);
+        void insert(NameId id, std::string_view name);
+    };
+
+    /**
+     * Names shared by a table and its snapshots
+     */
+    struct Storage {
+        std::shared_ptr<const PackFile> pack_;
+        size_t base_count_;         // names stored in the pack
+        // Names added since; a deque never moves its elements, so the
+        // views below stay valid
+        std::deque<std::string> strings_;
+        AppendArray<std::string_view> names_;   // indexed by id - base_count_
+        std::atomic<const HashIndex*> index_;
+        std::vector<std::unique_ptr<HashIndex> > indexes_;  // current and retired
+
+        Storage() : base_count_(0), index_(NULL) {}
+    };
+
+    explicit NameTable(std::shared_ptr<Storage> storage);
+
+    // Replaced by attach(); read with std::atomic_load by freeze()
+    std::shared_ptr<Storage> storage_;
+    size_t size_;
+};
+
+/**
+ * One file of a state (value_ is its content) or of a diff (value_ is
+ * the change relative to the parent commit)
+ */
+struct FileEntry {
+    NameId name_;
+    int value_;
+
+    FileEntry(NameId name = 0, int value = 0) : name_(name), value_(value) {}
+};
+
+/**
+ * Contiguous list of files sorted by NameId. Used for diffs and for
+ * flattened states so composition is a linear merge over flat memory.
+ */
+typedef std::vector<FileEntry> FileVec;
+
+/**
+ * Read-only range of FileEntry records. Either plain records, owned by a
+ * FileVec or mapped from a pack file, or a packed encoding (see
+ * encode_files()) that the iterator decodes as it goes; consumers see
+ * FileEntry values sorted by NameId either way.
+ */
+class DiffView {
+public:
+    class const_iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef FileEntry value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const FileEntry* pointer;
+        typedef const FileEntry& reference;
+
+        const FileEntry& operator*() const {
+            return raw_ ? *raw_ : entry_;
+        }
+
+        const FileEntry* operator->() const {
+            return raw_ ? raw_ : &entry_;
+        }
+
+        const_iterator& operator++() {
+            if (raw_) ++raw_;
+            else if (--left_ > 0) decode();
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return raw_ == other.raw_ && left_ == other.left_;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class DiffView;
+
+        const_iterator(const FileEntry* raw, const unsigned char* packed, size_t left) :
+            raw_(raw), packed_(packed), left_(left)
+        {
+            if (!raw_ && left_ > 0) decode();
+        }
+
+        /** Reads the next entry: name delta, then zig-zag value */
+        void decode() {
+            entry_.name_ += read_varint();
+            uint32_t zigzag = read_varint();
+            entry_.value_ = (int)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+        }
+
+        uint32_t read_varint() {
+            uint32_t x = 0;
+            for (unsigned shift = 0; ; shift += 7) {
+                unsigned char byte = *packed_++;
+                x |= (uint32_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return x;
+            }
+        }
+
+        const FileEntry* raw_;          // NULL for a packed range
+        const unsigned char* packed_;   // next undecoded byte
+        size_t left_;                   // packed entries left, current included
+        FileEntry entry_;               // current packed entry
+    };
+
+    DiffView() : begin_(NULL), end_(NULL), packed_(NULL), count_(0) {}
+    DiffView(const FileEntry* begin, const FileEntry* end) :
+        begin_(begin), end_(end), packed_(NULL), count_(end - begin) {}
+    DiffView(const FileVec& files) :
+        begin_(files.data()), end_(files.data() + files.size()), packed_(NULL),
+        count_(files.size()) {}
+
+    /** `count` entries written by encode_files() at `packed` */
+    DiffView(const unsigned char* packed, size_t count) :
+        begin_(NULL), end_(NULL), packed_(packed), count_(count) {}
+
+    const_iterator begin() const {
+        return const_iterator(begin_, packed_, begin_ ? 0 : count_);
+    }
+
+    const_iterator end() const {
+        return const_iterator(end_, NULL, 0);
+    }
+
+    size_t size() const {
+        return count_;
+    }
+
+    bool empty() const {
+        return count_ == 0;
+    }
+
+private:
+    const FileEntry* begin_;
+    const FileEntry* end_;
+    const unsigned char* packed_;
+    size_t count_;
+};
+
+/**
+ * Appends the packed encoding of `files` to `out`: per entry, the NameId
+ * minus the previous one, then the value zig-zag coded, each as a
+ * little-endian base-128 varint. A diff of nearby files with small
+ * changes takes 2-3 bytes per entry rather than sizeof(FileEntry).
+ */
+void encode_files(DiffView files, std::vector<unsigned char>& out);
+
+/**
+ * Writes "name : value" lines for the given files, ordered by filename
+ */
+void write_files(std::ostream& out, const NameTable& names, DiffView files);
+
+#endif
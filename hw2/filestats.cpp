@@ -0,0 +1,75 @@
+#include "filestats.h"
+
+using namespace std;
+
+ValueIndex::ValueIndex() : sum_(0), count_(0)
+{
+}
+
+void ValueIndex::insert(int value)
+{
+    counts_[value]++;
+    sum_ += value;
+    count_++;
+}
+
+void ValueIndex::erase(int value)
+{
+    std::map<int, size_t>::iterator it = counts_.find(value);
+    if (--it->second == 0) counts_.erase(it);
+    sum_ -= value;
+    count_--;
+}
+
+void ValueIndex::clear()
+{
+    counts_.clear();
+    sum_ = 0;
+    count_ = 0;
+}
+
+FileStats ValueIndex::stats() const
+{
+    FileStats stats;
+    stats.sum_ = sum_;
+    stats.count_ = count_;
+    if (count_ > 0) {
+        stats.min_ = counts_.begin()->first;
+        stats.max_ = counts_.rbegin()->first;
+    }
+    return stats;
+}
+
+FileStats ValueIndex::stats(const std::vector<int>& removed, const std::vector<int>& added) const
+{
+    FileStats stats;
+    std::map<int, long> change;
+    stats.sum_ = sum_;
+    stats.count_ = count_ - removed.size() + added.size();
+    for (int value : removed) {
+        change[value]--;
+        stats.sum_ -= value;
+    }
+    for (int value : added) {
+        change[value]++;
+        stats.sum_ += value;
+    }
+    if (stats.count_ == 0) return stats;
+
+    // The ends of the index, skipping values whose every occurrence was
+    // removed (at most one step per removed value), against the ends of
+    // what was added
+    std::map<int, size_t>::const_iterator low = counts_.begin();
+    while (low != counts_.end() && (long)low->second + change[low->first] == 0) ++low;
+    std::map<int, size_t>::const_reverse_iterator high = counts_.rbegin();
+    while (high != counts_.rend() && (long)high->second + change[high->first] == 0) ++high;
+    bool first = true;
+    for (int value : added) {
+        if (first || value < stats.min_) stats.min_ = value;
+        if (first || value > stats.max_) stats.max_ = value;
+        first = false;
+    }
+    if (low != counts_.end() && (first || low->first < stats.min_)) stats.min_ = low->first;
+    if (high != counts_.rend() && (first || high->first > stats.max_)) stats.max_ = high->first;
+    return stats;
+}
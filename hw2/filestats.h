@@ -0,0 +1,52 @@
+#ifndef FILESTATS_H
+#define FILESTATS_H
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Aggregates over the values of every file in a state. min_ and max_
+ * are meaningless when count_ is 0.
+ */
+struct FileStats {
+    int64_t sum_;
+    uint32_t count_;
+    int32_t min_;
+    int32_t max_;
+
+    FileStats() : sum_(0), count_(0), min_(0), max_(0) {}
+};
+
+/**
+ * Ordered multiset of file values: keeps FileStats for a changing state
+ * in O(log n) per changed file, with min and max read off the ends.
+ */
+class ValueIndex {
+public:
+    ValueIndex();
+
+    void insert(int value);
+
+    /** Removes one occurrence of `value`, which must be present */
+    void erase(int value);
+
+    void clear();
+
+    /** Aggregates of the values held */
+    FileStats stats() const;
+
+    /**
+     * Aggregates after replacing the values in `removed` (each present)
+     * by those in `added`, without changing the index. O(k log n) for k
+     * replaced values.
+     */
+    FileStats stats(const std::vector<int>& removed, const std::vector<int>& added) const;
+
+private:
+    std::map<int, size_t> counts_;      // value -> files holding it
+    int64_t sum_;
+    size_t count_;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include <cstdint>
+#include "filetree.h"
+
+using namespace std;
+
+namespace {
+
+const unsigned BITS = 5;
+const unsigned WIDTH = 1u << BITS;
+const unsigned MASK = WIDTH - 1;
+
+/**
+ * Hash of one file for FileTree::hash(), mixed (splitmix64 finalizer) so
+ * that sums over different sets of files collide no more than chance
+ */
+uint64_t file_hash(NameId name, int value)
+{
+    uint64_t x = ((uint64_t)name << 32) | (uint32_t)value;
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+}
+
+struct FileTree::Node {
+};
+
+struct FileTree::Leaf : FileTree::Node {
+    uint32_t present_;      // bit i set if slot i holds a file
+    int values_[WIDTH];
+
+    Leaf() : present_(0) {}
+};
+
+struct FileTree::Inner : FileTree::Node {
+    NodePtr children_[WIDTH];
+};
+
+template <typename T>
+T* FileTree::writable(NodePtr& slot, size_t& bytes)
+{
+    if (!slot) {
+        slot = make_shared<T>();
+        bytes += sizeof(T);
+    } else if (slot.use_count() != 1) {
+        slot = make_shared<T>(*static_cast<T*>(slot.get()));
+        bytes += sizeof(T);
+    }
+    return static_cast<T*>(slot.get());
+}
+
+FileTree::FileTree() : shift_(0), size_(0), hash_(0)
+{
+}
+
+const int* FileTree::find(NameId name) const
+{
+    if (((uint64_t)name >> shift_) >= WIDTH) return NULL;
+    const Node* node = root_.get();
+    for (unsigned s = shift_; node && s > 0; s -= BITS) {
+        node = static_cast<const Inner*>(node)->children_[(name >> s) & MASK].get();
+    }
+    if (!node) return NULL;
+    const Leaf* leaf = static_cast<const Leaf*>(node);
+    if (!(leaf->present_ & (1u << (name & MASK)))) return NULL;
+    return &leaf->values_[name & MASK];
+}
+
+size_t FileTree::set(NameId name, int value)
+{
+    const int* old = find(name);
+    return update(name, old ? value - *old : value);
+}
+
+size_t FileTree::apply(DiffView diff)
+{
+    size_t bytes = 0;
+    for (DiffView::const_iterator d = diff.begin(); d != diff.end(); ++d) {
+        bytes += update(d->name_, d->value_);
+    }
+    return bytes;
+}
+
+size_t FileTree::update(NameId name, int delta)
+{
+    size_t bytes = 0;
+    // Add levels on top until the root covers the id
+    while (((uint64_t)name >> shift_) >= WIDTH) {
+        if (root_) {
+            shared_ptr<Inner> up = make_shared<Inner>();
+            bytes += sizeof(Inner);
+            up->children_[0] = root_;
+            root_ = up;
+        }
+        shift_ += BITS;
+    }
+    NodePtr* slot = &root_;
+    for (unsigned s = shift_; s > 0; s -= BITS) {
+        slot = &writable<Inner>(*slot, bytes)->children_[(name >> s) & MASK];
+    }
+    Leaf* leaf = writable<Leaf>(*slot, bytes);
+    uint32_t bit = 1u << (name & MASK);
+    int& value = leaf->values_[name & MASK];
+    if (leaf->present_ & bit) {
+        hash_ -= file_hash(name, value);
+        value += delta;
+    } else {
+        leaf->present_ |= bit;
+        value = delta;
+        size_++;
+    }
+    hash_ += file_hash(name, value);
+    return bytes;
+}
+
+FileVec FileTree::to_vec() const
+{
+    FileVec out;
+    out.reserve(size_);
+    flatten(root_.get(), shift_, 0, out);
+    return out;
+}
+
+FileVec FileTree::diff(const FileTree& from, const FileTree& to)
+{
+    FileVec out;
+    diff_nodes(from.root_.get(), from.shift_, to.root_.get(), to.shift_, 0, out);
+    return out;
+}
+
+bool FileTree::operator==(const FileTree& other) const
+{
+    if (same_as(other)) return true;
+    if (hash_ != other.hash_ || size_ != other.size_) return false;
+    // Of the same size, with nothing in `other` new or changed: equal
+    return diff(*this, other).empty();
+}
+
+void FileTree::flatten(const Node* node, unsigned shift, NameId base, FileVec& out)
+{
+    if (!node) return;
+    if (shift == 0) {
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        for (unsigned i = 0; i < WIDTH; i++) {
+            if (leaf->present_ & (1u << i)) {
+                out.push_back(FileEntry(base + i, leaf->values_[i]));
+            }
+        }
+        return;
+    }
+    const Inner* inner = static_cast<const Inner*>(node);
+    for (unsigned i = 0; i < WIDTH; i++) {
+        flatten(inner->children_[i].get(), shift - BITS, base + (i << shift), out);
+    }
+}
+
+void FileTree::diff_nodes(const Node* from, unsigned from_shift,
+                          const Node* to, unsigned to_shift,
+                          NameId base, FileVec& out)
+{
+    if (!to) return;
+    if (to_shift > from_shift) {
+        // `to` has more levels; all of `from` sits under its first child
+        const Inner* t = static_cast<const Inner*>(to);
+        for (unsigned i = 0; i < WIDTH; i++) {
+            diff_nodes(i == 0 ? from : NULL, from_shift,
+                       t->children_[i].get(), to_shift - BITS,
+                       base + (i << to_shift), out);
+        }
+        return;
+    }
+    if (from_shift > to_shift) {
+        // Only the first child of `from` overlaps with `to`
+        const Node* f = from ? static_cast<const Inner*>(from)->children_[0].get() : NULL;
+        diff_nodes(f, from_shift - BITS, to, to_shift, base, out);
+        return;
+    }
+    if (from == to) return;     // shared subtree, nothing changed
+
+    if (to_shift == 0) {
+        const Leaf* f = static_cast<const Leaf*>(from);
+        const Leaf* t = static_cast<const Leaf*>(to);
+        for (unsigned i = 0; i < WIDTH; i++) {
+            uint32_t bit = 1u << i;
+            if (!(t->present_ & bit)) continue;
+            if (f && (f->present_ & bit)) {
+                if (t->values_[i] - f->values_[i]) {
+                    out.push_back(FileEntry(base + i, t->values_[i] - f->values_[i]));
+                }
+            } else {
+                out.push_back(FileEntry(base + i, t->values_[i]));
+            }
+        }
+        return;
+    }
+    const Inner* f = static_cast<const Inner*>(from);
+    const Inner* t = static_cast<const Inner*>(to);
+    for (unsigned i = 0; i < WIDTH; i++) {
+        diff_nodes(f ? f->children_[i].get() : NULL, from_shift - BITS,
+                   t->children_[i].get(), to_shift - BITS,
+                   base + (i << to_shift), out);
+    }
+}
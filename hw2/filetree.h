@@ -0,0 +1,113 @@
+#ifndef FILETREE_H
+#define FILETREE_H
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include "filestate.h"
+
+/**
+ * Persistent (immutable, structurally shared) map from NameId to file
+ * value, stored as a 32-way trie indexed by the bits of the id.
+ *
+ * Copying a FileTree is a pointer copy. Updating one path-copies only
+ * the nodes between the root and the changed leaf, so a commit's tree
+ * shares every untouched node with its parent's tree. Nodes owned by a
+ * single tree are updated in place.
+ *
+ * Each tree also keeps a hash of its whole content: the sum of a mixed
+ * hash of every (name, value) pair, so it is independent of the order
+ * files were written in and each update adjusts it in O(1). Trees with
+ * different hashes differ; equal hashes mean equal content except with
+ * probability about 2^-64.
+ */
+class FileTree {
+public:
+    FileTree();
+
+    /** Number of files in the tree */
+    size_t size() const {
+        return size_;
+    }
+
+    /** Order-independent hash of every file and its value */
+    uint64_t hash() const {
+        return hash_;
+    }
+
+    /**
+     * Returns a pointer to the value of the given file, or NULL if absent
+     */
+    const int* find(NameId name) const;
+
+    /**
+     * Sets the given file to value, creating it if needed
+     *
+     * @returns bytes of nodes allocated by path copying
+     */
+    size_t set(NameId name, int value);
+
+    /**
+     * Adds every delta of `diff` into the tree; new files take the delta
+     * as their value.
+     *
+     * @returns bytes of nodes allocated by path copying
+     */
+    size_t apply(DiffView diff);
+
+    /**
+     * Flattens the tree into a FileVec sorted by id
+     */
+    FileVec to_vec() const;
+
+    /**
+     * Returns the files of `to` that are new or changed relative to
+     * `from`, as deltas. Subtrees shared by both trees are skipped, so
+     * the cost is proportional to the changes between them.
+     */
+    static FileVec diff(const FileTree& from, const FileTree& to);
+
+    /**
+     * True if both trees hold the same files with the same values. Checks
+     * the hash and size first; equal trees cost a diff, which skips the
+     * subtrees they share.
+     */
+    bool operator==(const FileTree& other) const;
+
+    /**
+     * True if both trees are the same version (shared root)
+     */
+    bool same_as(const FileTree& other) const {
+        return root_ == other.root_;
+    }
+
+private:
+    struct Node;
+    struct Leaf;
+    struct Inner;
+    typedef std::shared_ptr<Node> NodePtr;
+
+    /**
+     * Adds delta to the given file (creating it with value delta)
+     * @returns bytes of nodes allocated by path copying
+     */
+    size_t update(NameId name, int delta);
+
+    /**
+     * Returns the node in `slot` ready for modification: created if empty,
+     * copied if another tree still references it, otherwise as is.
+     */
+    template <typename T>
+    static T* writable(NodePtr& slot, size_t& bytes);
+
+    static void flatten(const Node* node, unsigned shift, NameId base, FileVec& out);
+    static void diff_nodes(const Node* from, unsigned from_shift,
+                           const Node* to, unsigned to_shift,
+                           NameId base, FileVec& out);
+
+    NodePtr root_;
+    unsigned shift_;    // bit offset of the root's child index
+    size_t size_;
+    uint64_t hash_;     // sum of file_hash() over every file
+};
+
+#endif
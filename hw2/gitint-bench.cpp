@@ -0,0 +1,285 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "gitint.h"
+using namespace std;
+
+/**
+ * Benchmark of the history engine over synthetic repositories. For each
+ * point of a parameter grid it builds a history of N commits over M
+ * files, each commit editing `churn` random files; every B commits it
+ * branches off a random earlier commit, and every T commits it adds a
+ * tag. It then times commit, checkout, diff N, diff A B, log and display
+ * and appends one CSV row per operation: latency percentiles,
+ * throughput, and the peak RSS of the run. Each grid point runs in a
+ * child process of its own, so peak RSS is that point's alone.
+ *
+ *   gitint-bench [--commits 1000,10000] [--files 100,10000] [--churn 4]
+ *                [--branch-every 0,100] [--tag-every 100] [--samples S]
+ *                [--seed N] [--csv FILE]
+ *
+ * A 0 for --branch-every or --tag-every means never.
+ */
+
+struct Options {
+    vector<int> commits_;
+    vector<int> files_;
+    vector<int> churn_;
+    vector<int> branch_every_;
+    vector<int> tag_every_;
+    int samples_;       // timed runs of each query
+    unsigned seed_;
+    string csv_;
+
+    Options() : samples_(200), seed_(1), csv_("bench.csv") {}
+};
+
+/**
+ * One point of the grid
+ */
+struct Config {
+    int commits_;
+    int files_;
+    int churn_;
+    int branch_every_;
+    int tag_every_;
+};
+
+/**
+ * Discards everything written to it
+ */
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) {
+        return c;
+    }
+    streamsize xsputn(const char*, streamsize n) {
+        return n;
+    }
+};
+
+typedef chrono::steady_clock Clock;
+
+double elapsed_ns(Clock::time_point start)
+{
+    return chrono::duration<double, nano>(Clock::now() - start).count();
+}
+
+/**
+ * Writes the CSV row of one operation from its latencies (nanoseconds)
+ */
+void write_row(ostream& csv, const Config& config, const char* op, vector<double>& samples,
+               long peak_rss_kb)
+{
+    if (samples.empty()) return;
+    sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double s : samples) total += s;
+    // Nearest-rank percentiles
+    size_t n = samples.size();
+    double p50 = samples[(n - 1) * 50 / 100];
+    double p90 = samples[(n - 1) * 90 / 100];
+    double p99 = samples[(n - 1) * 99 / 100];
+    csv << config.commits_ << ',' << config.files_ << ',' << config.churn_ << ','
+        << config.branch_every_ << ',' << config.tag_every_ << ',' << op << ','
+        << n << ',' << p50 / 1e3 << ',' << p90 / 1e3 << ',' << p99 / 1e3 << ','
+        << samples.back() / 1e3 << ',' << (total > 0 ? n / (total / 1e9) : 0.0) << ','
+        << peak_rss_kb << '\n';
+}
+
+/**
+ * Builds the history for `config`, times the operations and appends
+ * their rows to the CSV. Runs in a child process.
+ */
+int run_config(const Config& config, const Options& options)
+{
+    mt19937 rng(options.seed_);
+    NullBuffer null_buffer;
+    streambuf* saved = cout.rdbuf(&null_buffer);
+
+    GitInt repo;
+    vector<string> names;
+    for (int f = 0; f < config.files_; f++) {
+        names.push_back("f" + to_string(f));
+        repo.create(names.back(), 0);
+        repo.add(names.back());
+    }
+    repo.commit("files");
+
+    vector<double> commit_ns;
+    for (int k = 1; k < config.commits_; k++) {
+        if (config.branch_every_ > 0 && k % config.branch_every_ == 0) {
+            // Continue from a random earlier commit on a new branch
+            CommitIdx base = 1 + rng() % k;
+            string branch = "b" + to_string(k);
+            repo.create_branch(branch, base);
+            repo.switch_branch(branch);
+        }
+        for (int c = 0; c < config.churn_; c++) {
+            const string& name = names[rng() % names.size()];
+            // Unlike any earlier value, so the commit always changes something
+            repo.edit(name, k * 1000 + (int)(rng() % 1000));
+            repo.add(name);
+        }
+        Clock::time_point start = Clock::now();
+        repo.commit("c" + to_string(k));
+        commit_ns.push_back(elapsed_ns(start));
+        if (config.tag_every_ > 0 && k % config.tag_every_ == 0) {
+            repo.create_tag("t" + to_string(k), k + 1);
+        }
+    }
+
+    CommitIdx size = config.commits_ + 1;     // with "init"
+    vector<double> checkout_ns, diff_ns, diff2_ns, log_ns, display_ns;
+    for (int i = 0; i < options.samples_; i++) {
+        CommitIdx c = 1 + rng() % (size - 1);
+        Clock::time_point start = Clock::now();
+        repo.checkout(c);
+        // Checkouts are lazy: count the first read, which builds the files
+        repo.display(names[0]);
+        checkout_ns.push_back(elapsed_ns(start));
+
+        CommitIdx a = 1 + rng() % (size - 1), b = 1 + rng() % (size - 1);
+        if (a < b) swap(a, b);
+        start = Clock::now();
+        repo.diff(b);
+        diff_ns.push_back(elapsed_ns(start));
+
+        start = Clock::now();
+        repo.diff(a, b);
+        diff2_ns.push_back(elapsed_ns(start));
+
+        start = Clock::now();
+        repo.log();
+        log_ns.push_back(elapsed_ns(start));
+
+        start = Clock::now();
+        repo.display_all();
+        display_ns.push_back(elapsed_ns(start));
+    }
+    cout.rdbuf(saved);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    ofstream csv(options.csv_, ios::app);
+    write_row(csv, config, "commit", commit_ns, usage.ru_maxrss);
+    write_row(csv, config, "checkout", checkout_ns, usage.ru_maxrss);
+    write_row(csv, config, "diff_n", diff_ns, usage.ru_maxrss);
+    write_row(csv, config, "diff_a_b", diff2_ns, usage.ru_maxrss);
+    write_row(csv, config, "log", log_ns, usage.ru_maxrss);
+    write_row(csv, config, "display", display_ns, usage.ru_maxrss);
+    return csv ? 0 : 1;
+}
+
+bool parse_list(const char* text, vector<int>& out)
+{
+    out.clear();
+    stringstream list(text);
+    string item;
+    while (getline(list, item, ',')) {
+        out.push_back(max(0l, strtol(item.c_str(), NULL, 10)));
+    }
+    return !out.empty();
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        bool ok = i + 1 < argc;
+        if (ok && strcmp(argv[i], "--commits") == 0) {
+            ok = parse_list(argv[++i], options.commits_);
+        } else if (ok && strcmp(argv[i], "--files") == 0) {
+            ok = parse_list(argv[++i], options.files_);
+        } else if (ok && strcmp(argv[i], "--churn") == 0) {
+            ok = parse_list(argv[++i], options.churn_);
+        } else if (ok && strcmp(argv[i], "--branch-every") == 0) {
+            ok = parse_list(argv[++i], options.branch_every_);
+        } else if (ok && strcmp(argv[i], "--tag-every") == 0) {
+            ok = parse_list(argv[++i], options.tag_every_);
+        } else if (ok && strcmp(argv[i], "--samples") == 0) {
+            options.samples_ = max(1l, strtol(argv[++i], NULL, 10));
+        } else if (ok && strcmp(argv[i], "--seed") == 0) {
+            options.seed_ = strtoul(argv[++i], NULL, 10);
+        } else if (ok && strcmp(argv[i], "--csv") == 0) {
+            options.csv_ = argv[++i];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            cout << "Unknown option: " << argv[i] << endl;
+            return false;
+        }
+    }
+    if (options.commits_.empty()) options.commits_ = { 1000, 10000 };
+    if (options.files_.empty()) options.files_ = { 100, 10000 };
+    if (options.churn_.empty()) options.churn_ = { 4 };
+    if (options.branch_every_.empty()) options.branch_every_ = { 0, 100 };
+    if (options.tag_every_.empty()) options.tag_every_ = { 100 };
+    // A commit with nothing edited would fail
+    for (int n : options.churn_) {
+        if (n < 1) {
+            cout << "Invalid --churn: " << n << " (must be at least 1)" << endl;
+            return false;
+        }
+    }
+    for (int& n : options.commits_) n = max(2, n);
+    for (int& n : options.files_) n = max(1, n);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    ofstream csv(options.csv_);
+    csv << "commits,files,churn,branch_every,tag_every,op,count,"
+           "p50_us,p90_us,p99_us,max_us,ops_per_sec,peak_rss_kb\n";
+    csv.close();
+    if (!csv) {
+        cout << "Cannot write " << options.csv_ << endl;
+        return 1;
+    }
+
+    int failed = 0;
+    for (int commits : options.commits_) {
+        for (int files : options.files_) {
+            for (int churn : options.churn_) {
+                for (int branch_every : options.branch_every_) {
+                    for (int tag_every : options.tag_every_) {
+                        Config config = { commits, files, churn, branch_every, tag_every };
+                        Clock::time_point start = Clock::now();
+                        cout << "commits=" << commits << " files=" << files << " churn=" << churn
+                             << " branch_every=" << branch_every << " tag_every=" << tag_every
+                             << flush;
+                        pid_t pid = fork();
+                        if (pid == 0) {
+                            _exit(run_config(config, options));
+                        }
+                        int status = 1;
+                        if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                            cout << " FAILED" << endl;
+                            failed++;
+                            continue;
+                        }
+                        cout << " (" << elapsed_ns(start) / 1e9 << " s)" << endl;
+                    }
+                }
+            }
+        }
+    }
+    cout << "Results in " << options.csv_ << endl;
+    return failed ? 1 : 0;
+}
@@ -1,24 +1,248 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "gitint.h"
 // Add any necessary headers
 using namespace std;
 
 void print_exception_message(const std::string& what_msg);
 
-int main()
+/**
+ * Reads a command script line by line without a syscall per line: a
+ * regular file is memory-mapped, anything else (a pipe) is read in
+ * large blocks.
+ */
+class ScriptReader {
+public:
+    ScriptReader() : fd_(-1), map_(NULL), map_size_(0), at_(0), eof_(false) {}
+
+    ~ScriptReader() {
+        if (map_) munmap(map_, map_size_);
+        if (fd_ > 0) ::close(fd_);
+    }
+
+    /**
+     * Opens the script at `path` ("-" is standard input)
+     * Returns false if it cannot be opened.
+     */
+    bool open(const char* path) {
+        fd_ = strcmp(path, "-") == 0 ? 0 : ::open(path, O_RDONLY);
+        if (fd_ < 0) return false;
+        struct stat st;
+        if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (map != MAP_FAILED) {
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                map_ = static_cast<char*>(map);
+                map_size_ = st.st_size;
+                data_ = std::string_view(map_, map_size_);
+                eof_ = true;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Returns the next line (without its newline) in `line`; the view is
+     * valid until the next call. Returns false at the end of the script.
+     */
+    bool next(std::string_view& line) {
+        while (true) {
+            size_t end = data_.find('\n', at_);
+            if (end != std::string_view::npos) {
+                line = data_.substr(at_, end - at_);
+                at_ = end + 1;
+                return true;
+            }
+            if (eof_) {
+                if (at_ >= data_.size()) return false;
+                line = data_.substr(at_);
+                at_ = data_.size();
+                return true;
+            }
+            refill();
+        }
+    }
+
+private:
+    static const size_t BLOCK = 1u << 20;
+
+    void refill() {
+        // Keep the partial last line and append the next block after it
+        buffer_.erase(0, at_);
+        at_ = 0;
+        size_t used = buffer_.size();
+        buffer_.resize(used + BLOCK);
+        ssize_t n;
+        do {
+            n = ::read(fd_, &buffer_[used], BLOCK);
+        } while (n < 0 && errno == EINTR);
+        buffer_.resize(used + max((ssize_t)0, n));
+        if (n <= 0) eof_ = true;
+        data_ = buffer_;
+    }
+
+    int fd_;
+    char* map_;
+    size_t map_size_;
+    std::string buffer_;
+    std::string_view data_;     // mapped file or buffer_
+    size_t at_;
+    bool eof_;
+};
+
+/**
+ * Runs every command of a script with no menu or prompts, writing all
+ * output through one large buffer that is flushed when full and at the
+ * end. Reports throughput on stderr. Returns the exit status.
+ */
+int run_batch(GitInt& gitInt, const char* path)
 {
+    ScriptReader script;
+    if (!script.open(path)) {
+        cerr << "Cannot open script: " << path << endl;
+        return 1;
+    }
+    static char out_buffer[1u << 20];
+    cout.rdbuf()->pubsetbuf(out_buffer, sizeof(out_buffer));
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t commands = 0;
+    std::string_view line;
+    bool quit = false;
+    while (!quit && script.next(line)) {
+        commands++;
+        try {
+            quit = gitInt.process_command(line);
+        } catch (std::exception& e) {
+            print_exception_message(e.what());
+        }
+    }
+    try {
+        gitInt.sync_log();
+    } catch (std::exception& e) {
+        print_exception_message(e.what());
+    }
+    cout.flush();
+
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << commands << " commands in " << secs << " s ("
+         << (secs > 0 ? commands / secs : 0.0) << " commands/sec)" << endl;
+    return 0;
+}
+
+/**
+ * Applies the tuning options given on the command line:
+ *   --keyframe-interval K   (0 = adaptive)
+ *   --keyframe-budget BYTES
+ *   --compose-threads N     threads composing long cherry-picked ranges
+ *   --repo PATH             durable repository (PATH + PATH.wal)
+ *   --sync always|batch|none
+ *   --group-commit N        most records per fsync with --sync batch
+ *   --checkpoint-bytes BYTES
+ *   --batch FILE            run a script non-interactively ("-" = stdin)
+ *   --stats-dump FILE       append statistics as JSON lines to FILE
+ *   --stats-interval MS     how often to append them (default 1000)
+ * Returns false on an unknown option.
+ */
+bool parse_options(int argc, char* argv[], GitInt& gitInt, string& repo, WalOptions& wal,
+                   const char*& batch)
+{
+    const char* stats_dump = NULL;
+    uint64_t stats_interval = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--keyframe-interval") == 0 && i + 1 < argc) {
+            gitInt.set_keyframe_interval(strtoul(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--keyframe-budget") == 0 && i + 1 < argc) {
+            gitInt.set_keyframe_budget(strtoul(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--compose-threads") == 0 && i + 1 < argc) {
+            gitInt.set_compose_threads(strtoul(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--repo") == 0 && i + 1 < argc) {
+            repo = argv[++i];
+        } else if (strcmp(argv[i], "--sync") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "always") == 0) wal.sync_ = SYNC_ALWAYS;
+            else if (strcmp(argv[i], "batch") == 0) wal.sync_ = SYNC_BATCH;
+            else if (strcmp(argv[i], "none") == 0) wal.sync_ = SYNC_NONE;
+            else {
+                cout << "Unknown sync policy: " << argv[i] << endl;
+                return false;
+            }
+        } else if (strcmp(argv[i], "--group-commit") == 0 && i + 1 < argc) {
+            wal.group_records_ = max(1ul, strtoul(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--checkpoint-bytes") == 0 && i + 1 < argc) {
+            wal.checkpoint_bytes_ = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = argv[++i];
+        } else if (strcmp(argv[i], "--stats-dump") == 0 && i + 1 < argc) {
+            stats_dump = argv[++i];
+        } else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            stats_interval = strtoull(argv[++i], NULL, 10);
+        } else {
+            cout << "Unknown option: " << argv[i] << endl;
+            return false;
+        }
+    }
+    if (stats_dump) {
+        try {
+            gitInt.set_stats_dump(stats_dump, stats_interval);
+        } catch (std::exception& e) {
+            print_exception_message(e.what());
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    // Lets cin buffer piped input, so in_avail() below sees queued lines
+    ios::sync_with_stdio(false);
 
-    GitInt g;
     string cmd_line;
     bool quit;
     const string PROMPT_STARTER = "$ ";
 
-    g.print_menu();
     GitInt gitInt;
+    string repo;
+    WalOptions wal;
+    const char* batch = NULL;
+    if (!parse_options(argc, argv, gitInt, repo, wal, batch)) {
+        return 1;
+    }
+    if (!repo.empty()) {
+        try {
+            gitInt.attach_log(repo, wal);
+        } catch (std::exception& e) {
+            print_exception_message(e.what());
+            return 1;
+        }
+    }
+    if (batch) {
+        return run_batch(gitInt, batch);
+    }
+
+    gitInt.print_menu();
     do {
         quit = false;
+        // Out of queued input: make what has been logged durable before
+        // blocking (commands arriving together share one fsync)
+        if (cin.rdbuf()->in_avail() <= 0) {
+            try {
+                gitInt.sync_log();
+            } catch (std::exception& e) {
+                print_exception_message(e.what());
+            }
+        }
         cout << PROMPT_STARTER;
-        getline(cin, cmd_line);
+        if (!getline(cin, cmd_line)) break;
         try {
             quit = gitInt.process_command(cmd_line);
         } catch (std::exception& e) {
@@ -33,5 +257,5 @@ int main()
 
 void print_exception_message(const std::string& what_msg)
 {
-  cout << "Error - " << what_msg << endl;
+  cout << "Error - " << what_msg << '\n';
 }
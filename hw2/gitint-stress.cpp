@@ -0,0 +1,205 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include "gitint.h"
+using namespace std;
+
+/**
+ * Stress test and benchmark for concurrent readers: one writer thread
+ * keeps committing to a GitInt while reader threads take snapshots and
+ * run log, display, diff and point reads against them. Every commit k
+ * sets the file "count" to k, and every 16th also creates "n<k>" with
+ * value k, so a reader can check that each snapshot is consistent:
+ * "count" at commit c must read c and the newest "n<k>" must read k,
+ * whatever the writer is doing. Reports reads/sec for each number of
+ * reader threads.
+ *
+ *   gitint-stress [--threads 1,2,4] [--seconds S] [--files F] [--history N]
+ */
+
+struct Options {
+    vector<unsigned> threads_;
+    double seconds_;
+    int files_;
+    int history_;       // commits made before the readers start
+
+    Options() : seconds_(1.0), files_(1000), history_(10000) {}
+};
+
+/**
+ * Discards everything written to it
+ */
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) {
+        return c;
+    }
+    streamsize xsputn(const char*, streamsize n) {
+        return n;
+    }
+};
+
+const int NEW_FILE_INTERVAL = 16;
+
+/**
+ * Commit k: "count" becomes k and one other file changes; a new file
+ * (a new interned name) every NEW_FILE_INTERVAL commits
+ */
+void make_commit(GitInt& repo, int k, int files)
+{
+    string name = "f" + to_string(k % files);
+    repo.edit("count", k);
+    repo.edit(name, k);
+    repo.add("count");
+    repo.add(name);
+    if (k % NEW_FILE_INTERVAL == 0) {
+        string created = "n" + to_string(k);
+        repo.create(created, k);
+        repo.add(created);
+    }
+    repo.commit("c" + to_string(k));
+}
+
+/**
+ * Checks the files make_commit() leaves at commit c
+ */
+bool consistent(const Snapshot& view, CommitIdx c)
+{
+    int value, k = c - c % NEW_FILE_INTERVAL;
+    if (!view.value_at("count", c, value) || value != c) return false;
+    if (k > 0 && (!view.value_at("n" + to_string(k), c, value) || value != k)) return false;
+    return true;
+}
+
+struct ReaderStats {
+    uint64_t reads_;
+    uint64_t errors_;
+
+    ReaderStats() : reads_(0), errors_(0) {}
+};
+
+void reader(GitInt& repo, atomic<bool>& stop, unsigned seed, ReaderStats& stats)
+{
+    NullBuffer null_buffer;
+    ostream out(&null_buffer);
+    mt19937 rng(seed);
+    Snapshot view = repo.snapshot();
+    while (!stop.load(memory_order_relaxed)) {
+        // Refreshing every so often picks up the writer's progress
+        view.refresh(repo.snapshot());
+        CommitIdx size = view.size();
+        for (int i = 0; i < 256; i++) {
+            // Mostly recent commits, as a dashboard would ask for
+            CommitIdx c = size - 1 - (CommitIdx)(rng() % min<CommitIdx>(size - 1, 1000));
+            switch (rng() % 4) {
+            case 0:
+                view.log(out, c, 10);
+                break;
+            case 1:
+                view.display_commit(out, c);
+                break;
+            case 2:
+                view.diff(out, c, max(1, c - 5));
+                break;
+            case 3:
+                if (!consistent(view, c)) stats.errors_++;
+                break;
+            }
+            stats.reads_++;
+        }
+    }
+}
+
+/**
+ * Runs the writer and `count` readers for the configured time
+ */
+void run(GitInt& repo, int& next_commit, const Options& options, unsigned count)
+{
+    atomic<bool> stop(false);
+    vector<ReaderStats> stats(count);
+    vector<thread> readers;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < count; i++) {
+        readers.push_back(thread(reader, ref(repo), ref(stop), i + 1, ref(stats[i])));
+    }
+    int commits = 0;
+    while (chrono::duration<double>(chrono::steady_clock::now() - start).count() < options.seconds_) {
+        make_commit(repo, next_commit++, options.files_);
+        commits++;
+    }
+    stop = true;
+    for (thread& t : readers) t.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    uint64_t reads = 0, errors = 0;
+    for (const ReaderStats& s : stats) {
+        reads += s.reads_;
+        errors += s.errors_;
+    }
+    cout << count << " readers: " << (uint64_t)(reads / secs) << " reads/sec ("
+         << (uint64_t)(reads / secs / count) << " per thread), writer "
+         << (uint64_t)(commits / secs) << " commits/sec";
+    if (errors) cout << ", " << errors << " INCONSISTENT READS";
+    cout << endl;
+    if (errors) exit(1);
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            stringstream list(argv[++i]);
+            string item;
+            while (getline(list, item, ',')) {
+                options.threads_.push_back(max(1ul, strtoul(item.c_str(), NULL, 10)));
+            }
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            options.seconds_ = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) {
+            options.files_ = max(1l, strtol(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            options.history_ = max(1l, strtol(argv[++i], NULL, 10));
+        } else {
+            cout << "Unknown option: " << argv[i] << endl;
+            return false;
+        }
+    }
+    if (options.threads_.empty()) {
+        unsigned cores = max(1u, thread::hardware_concurrency());
+        for (unsigned n = 1; n < cores; n *= 2) options.threads_.push_back(n);
+        options.threads_.push_back(cores);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+
+    GitInt repo;
+    repo.create("count", 0);
+    for (int f = 0; f < options.files_; f++) {
+        repo.create("f" + to_string(f), 0);
+    }
+    int next_commit = 1;
+    while (next_commit <= options.history_) {
+        make_commit(repo, next_commit++, options.files_);
+    }
+    cout << options.history_ << " commits, " << options.files_ << " files, "
+         << thread::hardware_concurrency() << " cores" << endl;
+
+    for (unsigned count : options.threads_) {
+        run(repo, next_commit, options, count);
+    }
+    return 0;
+}
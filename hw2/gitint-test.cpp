@@ -0,0 +1,956 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gitint.h"
+using namespace std;
+
+/**
+ * Regression tests with known expected output: each test runs a script
+ * through GitInt::process_command, as the shell does, and compares all
+ * it prints (errors included) with the text it must print. The durable
+ * tests also write, cut and corrupt the pack and write-ahead log on disk
+ * between runs. Prints one line per test; exits with 1 if any fails.
+ *
+ *   gitint-test
+ */
+
+/**
+ * Runs each line of `script`, returning what it printed; an error is
+ * printed as the shell prints it
+ */
+string run(GitInt& repo, const string& script)
+{
+    ostringstream out;
+    streambuf* saved = cout.rdbuf(out.rdbuf());
+    istringstream lines(script);
+    string line;
+    while (getline(lines, line)) {
+        try {
+            repo.process_command(line);
+        } catch (std::exception& e) {
+            cout << "Error - " << e.what() << '\n';
+        }
+    }
+    cout.rdbuf(saved);
+    return out.str();
+}
+
+/** Size of the file at `path`, -1 if there is none */
+long file_size(const string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+/** Rewrites byte `offset` of the file at `path` with its complement */
+void corrupt(const string& path, long offset)
+{
+    fstream file(path, ios::in | ios::out | ios::binary);
+    file.seekg(offset);
+    char byte = (char)file.get();
+    file.seekp(offset);
+    file.put((char)~byte);
+}
+
+/** Offset of the first occurrence of `text` in the file at `path` */
+long find_in_file(const string& path, const string& text)
+{
+    ifstream file(path, ios::binary);
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    size_t at = data.find(text);
+    return at == string::npos ? -1 : (long)at;
+}
+
+/**
+ * Opens the durable repository at `path` in a fresh GitInt (replaying
+ * its log), runs `script` and closes it again, returning the output
+ */
+string run_durable(const string& path, const string& script)
+{
+    WalOptions options;
+    options.sync_ = SYNC_ALWAYS;
+    GitInt repo;
+    repo.attach_log(path, options);
+    return run(repo, script);
+}
+
+/*********************** Tests ************************************************/
+// Scratch directory for the durable tests, made by main()
+string scratch;
+
+const char* const LOGGED =
+    "create a 1\n"
+    "add a\n"
+    "commit \"one\"\n"
+    "edit a 2\n"
+    "add a\n"
+    "commit \"two\"\n";
+
+/**
+ * A record cut short by a crash is dropped with nothing after it, and
+ * the log goes on from before it
+ */
+string test_wal_torn_tail()
+{
+    string path = scratch + "/torn";
+    run_durable(path, LOGGED);
+    // Into the last record, the commit of "two"
+    if (truncate((path + ".wal").c_str(), file_size(path + ".wal") - 2) != 0) return "truncate";
+    string out = run_durable(path, "log\ndisplay\ncommit \"two again\"\n");
+    return out + run_durable(path, "log\n");
+}
+
+const char* const WAL_TORN_TAIL_ANSWERS =
+    "Commit: 1\n"
+    "one\n"
+    "\n"
+    "a : 2\n"
+    "Commit: 2\n"
+    "two again\n"
+    "\n"
+    "Commit: 1\n"
+    "one\n"
+    "\n";
+
+/** A record failing its checksum ends the log, intact ones after it too */
+string test_wal_checksum()
+{
+    string path = scratch + "/checksum";
+    run_durable(path, LOGGED);
+    long at = find_in_file(path + ".wal", "one");
+    if (at < 0) return "no record";
+    corrupt(path + ".wal", at);
+    return run_durable(path, "log\ndisplay\n");
+}
+
+const char* const WAL_CHECKSUM_ANSWERS =
+    "a : 1\n";
+
+/**
+ * A checkpoint moves history into the pack and leaves the log only the
+ * uncommitted changes, which survive the next open
+ */
+string test_wal_checkpoint()
+{
+    string path = scratch + "/checkpoint";
+    run_durable(path, string(LOGGED) + "edit a 7\ncheckpoint\n");
+    // Header, then "edit a 7": length, crc32, type, value and the name
+    long expected = 16 + 4 + 4 + 1 + 8 + 1;
+    if (file_size(path + ".wal") != expected) {
+        return "log of " + to_string(file_size(path + ".wal")) + " bytes after the checkpoint";
+    }
+    string out = run_durable(path, "log\ndisplay\nadd a\ncommit \"three\"\n");
+    return out + run_durable(path, "log -n 1\ndisplay 3\n");
+}
+
+const char* const WAL_CHECKPOINT_ANSWERS =
+    "Commit: 2\n"
+    "two\n"
+    "\n"
+    "Commit: 1\n"
+    "one\n"
+    "\n"
+    "a : 7\n"
+    "Commit: 3\n"
+    "three\n"
+    "\n"
+    "a : 5\n";
+
+const char* const HISTORY =
+    "create a 1\n"
+    "create b 2\n"
+    "add a b\n"
+    "commit \"base\"\n"
+    "tag -a v1\n"
+    "branch main\n"
+    "branch topic\n"
+    "switch main\n"
+    "edit a 5\n"
+    "add a\n"
+    "commit \"raise a\"\n"
+    "switch topic\n"
+    "create c 3\n"
+    "add c\n"
+    "commit \"add c\"\n"
+    "switch main\n"
+    "merge topic\n";
+
+const char* const HISTORY_QUERIES =
+    "log\n"
+    "tag\n"
+    "branch\n"
+    "display\n"
+    "display a@1\n"
+    "display 4\n"
+    "display c@3\n"
+    "display c@2\n"
+    "diff 4 1\n"
+    "merge-base 2 3\n"
+    "merge-base 4 3\n";
+
+const char* const HISTORY_ANSWERS =
+    "Commit: 4\n"
+    "Merge topic\n"
+    "\n"
+    "Commit: 2\n"
+    "raise a\n"
+    "\n"
+    "Commit: 1\n"
+    "base\n"
+    "\n"
+    "v1\n"
+    "* main\n"
+    "  topic\n"
+    "a : 5\n"
+    "b : 2\n"
+    "c : 3\n"
+    "1\n"
+    "c : 3\n"
+    "3\n"
+    "Error - Invalid command\n"
+    "a : 4\n"
+    "c : 3\n"
+    "1\n"
+    "3\n";
+
+/** A pack read back answers as the repository that wrote it did */
+string test_save_open()
+{
+    string path = scratch + "/round-trip.pack";
+    GitInt written;
+    run(written, HISTORY);
+    string before = run(written, "save " + path + "\n" + HISTORY_QUERIES);
+    GitInt opened;
+    string after = run(opened, "open " + path + "\n" + HISTORY_QUERIES);
+    if (before != HISTORY_ANSWERS) return before;
+    return after;
+}
+
+/** Both sides changed a file since the merge base */
+string test_merge_conflict()
+{
+    GitInt repo;
+    return run(repo,
+        "create a 1\n"
+        "create b 2\n"
+        "add a b\n"
+        "commit \"base\"\n"
+        "branch main\n"
+        "branch topic\n"
+        "switch main\n"
+        "edit a 10\n"
+        "add a\n"
+        "commit \"main edits a\"\n"
+        "switch topic\n"
+        "edit a 20\n"
+        "edit b 5\n"
+        "add a b\n"
+        "commit \"topic edits a and b\"\n"
+        "switch main\n"
+        "merge topic\n"
+        "display\n"
+        "merge-base 2 3\n"
+        "merge topic\n");
+}
+
+const char* const MERGE_CONFLICT_ANSWERS =
+    "Conflict: a : 9 + 19\n"
+    "a : 29\n"
+    "b : 5\n"
+    "1\n"
+    "Already up to date\n";
+
+/** gc drops the unreachable and renumbers what it keeps */
+string test_gc_squash()
+{
+    GitInt repo;
+    return run(repo,
+        "create a 1\n"
+        "add a\n"
+        "commit \"one\"\n"
+        "edit a 2\n"
+        "add a\n"
+        "commit \"two\"\n"
+        "edit a 3\n"
+        "add a\n"
+        "commit \"three\"\n"
+        "tag -a keep\n"
+        "edit a 4\n"
+        "add a\n"
+        "commit \"four\"\n"
+        "edit a 5\n"
+        "add a\n"
+        "commit \"five\"\n"
+        "checkout 1\n"
+        "edit a 9\n"
+        "add a\n"
+        "commit \"stray\"\n"
+        "checkout 5\n"
+        "gc --squash 1\n"
+        "log\n"
+        "display 1\n"
+        "display 2\n"
+        "checkout keep\n"
+        "display\n"
+        "checkout 2\n"
+        "display\n"
+        "checkout 3\n");
+}
+
+const char* const GC_SQUASH_ANSWERS =
+    "Removed 1 unreachable and 3 squashed commits; reclaimed 23 bytes (messages and diffs "
+    "40 -> 17 bytes, commits 7 -> 3)\n"
+    "Commit: 2\n"
+    "five\n"
+    "\n"
+    "Commit: 1\n"
+    "three\n"
+    "\n"
+    "a : 3\n"
+    "a : 2\n"
+    "a : 3\n"
+    "a : 5\n"
+    "Error - Invalid command\n";
+
+/** Picked and rebased commits re-apply their stored diffs */
+string test_cherry_pick_rebase()
+{
+    GitInt repo;
+    return run(repo,
+        "create a 1\n"
+        "create b 1\n"
+        "add a b\n"
+        "commit \"base\"\n"
+        "branch main\n"
+        "branch topic\n"
+        "switch topic\n"
+        "edit a 3\n"
+        "add a\n"
+        "commit \"a +2\"\n"
+        "create c 7\n"
+        "add c\n"
+        "commit \"add c\"\n"
+        "edit b 11\n"
+        "add b\n"
+        "commit \"b +10\"\n"
+        "switch main\n"
+        "edit b 2\n"
+        "add b\n"
+        "commit \"b +1\"\n"
+        "cherry-pick 3\n"
+        "display\n"
+        "cherry-pick 1..4\n"
+        "display\n"
+        "rebase main..topic onto main\n"
+        "branch\n"
+        "log -n 4\n"
+        "display\n");
+}
+
+const char* const CHERRY_PICK_REBASE_ANSWERS =
+    "a : 1\n"
+    "b : 2\n"
+    "c : 7\n"
+    "a : 3\n"
+    "b : 12\n"
+    "c : 14\n"
+    "  main\n"
+    "* topic\n"
+    "Commit: 10\n"
+    "b +10\n"
+    "\n"
+    "Commit: 9\n"
+    "add c\n"
+    "\n"
+    "Commit: 8\n"
+    "a +2\n"
+    "\n"
+    "Commit: 7\n"
+    "Cherry-pick 1..4\n"
+    "\n"
+    "a : 5\n"
+    "b : 22\n"
+    "c : 21\n";
+
+/** Words split on any blank; numbers read as `>>` reads them */
+string test_tokenizer()
+{
+    GitInt repo;
+    return run(repo,
+        "\tcreate   a\t 5x\n"
+        "create b +7\n"
+        "create c -3\n"
+        "create d x\n"
+        "create e 99999999999\n"
+        "create f\n"
+        "\n"
+        "   \n"
+        "add  a\tb   c\n"
+        "commit   \"two  words\"  trailing\n"
+        "commit no quotes\n"
+        "commit \"unclosed\n"
+        "display\n"
+        "display 1abc\n"
+        "display 99999999999\n"
+        "log\n");
+}
+
+const char* const TOKENIZER_ANSWERS =
+    "Error - Invalid command\n"
+    "Error - Invalid command\n"
+    "Error - Invalid command\n"
+    "Error - Invalid command\n"
+    "Error - Invalid command\n"
+    "Error - Invalid command\n"
+    "Error - Invalid command\n"
+    "a : 5\n"
+    "b : 7\n"
+    "c : -3\n"
+    "a : 5\n"
+    "b : 7\n"
+    "c : -3\n"
+    "Error - stoi\n"
+    "Commit: 1\n"
+    "two  words\n"
+    "\n";
+
+/**
+ * Ranges and merge bases over a first-parent chain long enough for the
+ * skip pointers, with a merged branch beside it
+ */
+string test_log_range_merge_base()
+{
+    string script =
+        "create a 0\n"
+        "add a\n"
+        "commit \"base\"\n"
+        "branch main\n"
+        "branch topic\n"
+        "switch main\n";
+    // Commits 2 to 31 on main, 32 to 36 on topic, 37 the merge
+    for (int i = 2; i <= 36; i++) {
+        if (i == 32) script += "switch topic\n";
+        script += "edit a " + to_string(i) + "\nadd a\ncommit \"c" + to_string(i) + "\"\n";
+    }
+    script += "switch main\nmerge topic\n";
+    GitInt repo;
+    run(repo, script);
+    return run(repo,
+        "merge-base 31 36\n"
+        "merge-base 37 36\n"
+        "merge-base 25 31\n"
+        "merge-base 20 37\n"
+        "log 30..37\n"
+        "log 37..36\n"
+        "log 2..4\n"
+        "log 1..99\n"
+        "log -n 2\n");
+}
+
+const char* const LOG_RANGE_MERGE_BASE_ANSWERS =
+    "1\n"
+    "36\n"
+    "25\n"
+    "20\n"
+    "Commit: 37\n"
+    "Merge topic\n"
+    "\n"
+    "Commit: 36\n"
+    "c36\n"
+    "\n"
+    "Commit: 35\n"
+    "c35\n"
+    "\n"
+    "Commit: 34\n"
+    "c34\n"
+    "\n"
+    "Commit: 33\n"
+    "c33\n"
+    "\n"
+    "Commit: 32\n"
+    "c32\n"
+    "\n"
+    "Commit: 31\n"
+    "c31\n"
+    "\n"
+    "Commit: 4\n"
+    "c4\n"
+    "\n"
+    "Commit: 3\n"
+    "c3\n"
+    "\n"
+    "Error - Invalid commit number\n"
+    "Commit: 37\n"
+    "Merge topic\n"
+    "\n"
+    "Commit: 31\n"
+    "c31\n"
+    "\n";
+
+/**
+ * A file's history answers for commits on the branch checked out only,
+ * past more touches on another branch than are scanned before the
+ * index is rebuilt
+ */
+string test_file_history()
+{
+    string script =
+        "create a 1\n"
+        "create b 1\n"
+        "add a b\n"
+        "commit \"base\"\n"
+        "branch main\n"
+        "branch topic\n"
+        "switch topic\n";
+    // Commits 2 to 41 change b on topic
+    for (int i = 2; i <= 41; i++) {
+        script += "edit b " + to_string(100 + i) + "\nadd b\ncommit \"b" + to_string(i) + "\"\n";
+    }
+    script +=
+        "switch main\n"
+        "edit b 7\n"
+        "add b\n"
+        "commit \"main b\"\n"
+        "edit a 8\n"
+        "add a\n"
+        "commit \"main a\"\n";
+    GitInt repo;
+    run(repo, script);
+    return run(repo,
+        "log -- b\n"
+        "log -- a\n"
+        "log -- nosuch\n"
+        "display b@41\n"
+        "display b@42\n"
+        "display b@43\n"
+        "display a@30\n"
+        "display b@99\n"
+        "display nosuch@1\n"
+        "create x@1 5\n"
+        "display x@1\n"
+        "checkout 4\n"
+        "log -- b\n"
+        "display b@\n");
+}
+
+const char* const FILE_HISTORY_ANSWERS =
+    "Commit: 42\n"
+    "main b\n"
+    "\n"
+    "Commit: 1\n"
+    "base\n"
+    "\n"
+    "Commit: 43\n"
+    "main a\n"
+    "\n"
+    "Commit: 1\n"
+    "base\n"
+    "\n"
+    "Error - Invalid command\n"
+    "141\n"
+    "7\n"
+    "7\n"
+    "1\n"
+    "Error - Invalid commit number\n"
+    "Error - Invalid command\n"
+    "5\n"
+    "Commit: 4\n"
+    "b4\n"
+    "\n"
+    "Commit: 3\n"
+    "b3\n"
+    "\n"
+    "Commit: 2\n"
+    "b2\n"
+    "\n"
+    "Commit: 1\n"
+    "base\n"
+    "\n"
+    "104\n";
+
+/**
+ * Commits the writer makes after a snapshot, or a pack it opens, stay
+ * out of the view until refresh(); answers match the shell's commands
+ */
+string test_snapshot_readers()
+{
+    string path = scratch + "/snapshot.pack";
+    GitInt other;
+    run(other, "create z 9\nadd z\ncommit \"other\"\nsave " + path + "\n");
+
+    GitInt repo;
+    run(repo, HISTORY);
+    Snapshot view = repo.snapshot();
+    // Commits 5 to 74 set a to their number, past a published state
+    string more;
+    for (int i = 5; i <= 74; i++) {
+        more += "edit a " + to_string(i) + "\nadd a\ncommit \"a" + to_string(i) + "\"\n";
+    }
+    run(repo, more);
+
+    ostringstream out;
+    int value = 0;
+    out << view.size() << '\n';
+    view.log(out, 4, 2);
+    view.display_commit(out, 3);
+    view.diff(out, 4, 1);
+    out << view.value_at("a", 4, value) << ' ' << value << '\n';
+    out << view.value_at("c", 1, value) << '\n';
+    try {
+        view.log(out, 5, 1);
+    } catch (std::exception& e) {
+        out << "Error - " << e.what() << '\n';
+    }
+
+    view.refresh(repo.snapshot());
+    out << view.size() << '\n';
+    view.log(out, 74, 1);
+    out << view.value_at("a", 70, value) << ' ' << value << '\n';
+    out << view.value_at("b", 74, value) << ' ' << value << '\n';
+
+    run(repo, "open " + path + "\n");
+    out << view.value_at("a", 74, value) << ' ' << value << '\n';
+    view.refresh(repo.snapshot());
+    out << view.size() << '\n';
+    out << view.value_at("z", 1, value) << ' ' << value << '\n';
+    return out.str();
+}
+
+const char* const SNAPSHOT_READERS_ANSWERS =
+    "5\n"
+    "Commit: 4\n"
+    "Merge topic\n"
+    "\n"
+    "Commit: 2\n"
+    "raise a\n"
+    "\n"
+    "c : 3\n"
+    "a : 4\n"
+    "c : 3\n"
+    "1 5\n"
+    "0\n"
+    "Error - Invalid commit number\n"
+    "75\n"
+    "Commit: 74\n"
+    "a74\n"
+    "\n"
+    "1 70\n"
+    "1 2\n"
+    "1 74\n"
+    "2\n"
+    "1 9\n";
+
+/**
+ * Commits that return to an earlier state are found by it, share it,
+ * and still check out their own files, before and after a pack
+ */
+string test_find_state()
+{
+    string path = scratch + "/find-state.pack";
+    GitInt repo;
+    string out = run(repo,
+        "create a 1\n"
+        "create b 1\n"
+        "add a b\n"
+        "commit \"one\"\n"
+        "edit a 2\n"
+        "add a\n"
+        "commit \"a 2\"\n"
+        "edit a 1\n"
+        "add a\n"
+        "commit \"a back\"\n"
+        "edit b 2\n"
+        "add b\n"
+        "commit \"b 2\"\n"
+        "edit b 1\n"
+        "add b\n"
+        "commit \"b back\"\n"
+        "find-state 5\n"
+        "find-state 4\n"
+        "find-state\n"
+        "edit a 2\n"
+        "find-state\n"
+        "find-state 99\n"
+        "checkout 3\n"
+        "display\n"
+        "checkout 4\n"
+        "display\n"
+        "save " + path + "\n");
+    GitInt opened;
+    return out + run(opened, "open " + path + "\nfind-state 3\ncheckout 5\ndisplay\n");
+}
+
+const char* const FIND_STATE_ANSWERS =
+    "Commit: 3\n"
+    "a back\n"
+    "\n"
+    "Commit: 1\n"
+    "one\n"
+    "\n"
+    "Commit: 5\n"
+    "b back\n"
+    "\n"
+    "Commit: 3\n"
+    "a back\n"
+    "\n"
+    "Commit: 1\n"
+    "one\n"
+    "\n"
+    "Commit: 2\n"
+    "a 2\n"
+    "\n"
+    "Error - Invalid commit number\n"
+    "a : 1\n"
+    "b : 1\n"
+    "a : 1\n"
+    "b : 2\n"
+    "Commit: 1\n"
+    "one\n"
+    "\n"
+    "a : 1\n"
+    "b : 1\n";
+
+/**
+ * Aggregates follow the largest and smallest values down and up, for
+ * commits, the working files and a pack read back
+ */
+string test_stat()
+{
+    string path = scratch + "/stat.pack";
+    GitInt repo;
+    string out = run(repo,
+        "stat\n"
+        "create a 5\n"
+        "create b -3\n"
+        "create c 10\n"
+        "add a b c\n"
+        "commit \"three\"\n"
+        "stat 1\n"
+        "edit c 1\n"
+        "edit b 4\n"
+        "stat\n"
+        "add b c\n"
+        "commit \"lower c, raise b\"\n"
+        "create d 1\n"
+        "stat\n"
+        "add d\n"
+        "commit \"add d\"\n"
+        "stat 2\n"
+        "stat 3\n"
+        "stat 1\n"
+        "stat 0\n"
+        "stat 99\n"
+        "checkout 1\n"
+        "stat\n"
+        "save " + path + "\n");
+    GitInt opened;
+    return out + run(opened, "open " + path + "\nstat 3\nstat\n");
+}
+
+const char* const STAT_ANSWERS =
+    "count : 0\n"
+    "sum : 0\n"
+    "count : 3\n"
+    "sum : 12\n"
+    "min : -3\n"
+    "max : 10\n"
+    "count : 3\n"
+    "sum : 10\n"
+    "min : 1\n"
+    "max : 5\n"
+    "count : 4\n"
+    "sum : 11\n"
+    "min : 1\n"
+    "max : 5\n"
+    "count : 3\n"
+    "sum : 10\n"
+    "min : 1\n"
+    "max : 5\n"
+    "count : 4\n"
+    "sum : 11\n"
+    "min : 1\n"
+    "max : 5\n"
+    "count : 3\n"
+    "sum : 12\n"
+    "min : -3\n"
+    "max : 10\n"
+    "count : 0\n"
+    "sum : 0\n"
+    "Error - Invalid commit number\n"
+    "count : 3\n"
+    "sum : 12\n"
+    "min : -3\n"
+    "max : 10\n"
+    "count : 4\n"
+    "sum : 11\n"
+    "min : 1\n"
+    "max : 5\n"
+    "count : 3\n"
+    "sum : 12\n"
+    "min : -3\n"
+    "max : 10\n";
+
+/** Writes `text` to the file at `path` */
+void write_file(const string& path, const string& text)
+{
+    ofstream(path, ios::binary) << text;
+}
+
+/**
+ * Records group into commits by key, across the parser's block
+ * boundaries; a malformed line keeps the commits before it
+ */
+string test_import()
+{
+    string small = scratch + "/small.csv";
+    write_file(small,
+        "commit,file,value\n"
+        "k1,a,1\n"
+        "k1,b,2\r\n"
+        "\n"
+        "k2,a,1\n"
+        "k2,c,3\n"
+        "k1,b,5\n");
+    // Over a megabyte: 3500 commits of 20 files
+    string large = scratch + "/large.csv";
+    string text;
+    for (int k = 1; k <= 3500; k++) {
+        for (int f = 0; f < 20; f++) {
+            text += "k" + to_string(k) + ",f" + to_string(f) + "," + to_string(k * 100 + f) + "\n";
+        }
+    }
+    write_file(large, text);
+    string bad = scratch + "/bad.csv";
+    write_file(bad, "k1,a,7\nk2,a,8\nk3 a 9\nk4,a,10\n");
+
+    // Progress goes to stderr
+    ostringstream progress;
+    streambuf* saved = cerr.rdbuf(progress.rdbuf());
+    GitInt repo;
+    string out = run(repo,
+        "import " + small + "\n"
+        "log\n"
+        "display 2\n"
+        "display\n"
+        "import " + scratch + "/none.csv\n"
+        "edit a 4\n"
+        "import " + small + "\n");
+    GitInt bulk;
+    out += run(bulk,
+        "import " + large + "\n"
+        "log -n 1\n"
+        "display f19@3500\n"
+        "display f0@1234\n"
+        "stat\n");
+    GitInt broken;
+    out += run(broken, "import " + bad + "\nlog\ndisplay\n");
+    cerr.rdbuf(saved);
+    return out;
+}
+
+const char* const IMPORT_ANSWERS =
+    "Imported 3 commits\n"
+    "Commit: 3\n"
+    "k1\n"
+    "\n"
+    "Commit: 2\n"
+    "k2\n"
+    "\n"
+    "Commit: 1\n"
+    "k1\n"
+    "\n"
+    "c : 3\n"
+    "a : 1\n"
+    "b : 5\n"
+    "c : 3\n"
+    "Error - Cannot open import file\n"
+    "Error - Uncommitted changes\n"
+    "Imported 3500 commits\n"
+    "Commit: 3500\n"
+    "k3500\n"
+    "\n"
+    "350019\n"
+    "123400\n"
+    "count : 20\n"
+    "sum : 7000190\n"
+    "min : 350000\n"
+    "max : 350019\n"
+    "Imported 1 commits\n"
+    "Error - Invalid import record at line 3\n"
+    "Commit: 1\n"
+    "k1\n"
+    "\n"
+    "a : 7\n";
+
+/*********************** Driver ***********************************************/
+struct Test {
+    const char* name_;
+    function<string()> run_;
+    const char* expected_;
+};
+
+/** Removes the scratch directory and everything in it */
+void remove_scratch()
+{
+    DIR* dir = opendir(scratch.c_str());
+    if (!dir) return;
+    while (struct dirent* entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        unlink((scratch + "/" + entry->d_name).c_str());
+    }
+    closedir(dir);
+    rmdir(scratch.c_str());
+}
+
+int main()
+{
+    char dir[] = "/tmp/gitint-test.XXXXXX";
+    if (!mkdtemp(dir)) {
+        cout << "Cannot make a scratch directory" << endl;
+        return 1;
+    }
+    scratch = dir;
+
+    const Test tests[] = {
+        { "wal-torn-tail", test_wal_torn_tail, WAL_TORN_TAIL_ANSWERS },
+        { "wal-checksum", test_wal_checksum, WAL_CHECKSUM_ANSWERS },
+        { "wal-checkpoint", test_wal_checkpoint, WAL_CHECKPOINT_ANSWERS },
+        { "save-open", test_save_open, HISTORY_ANSWERS },
+        { "merge-conflict", test_merge_conflict, MERGE_CONFLICT_ANSWERS },
+        { "gc-squash", test_gc_squash, GC_SQUASH_ANSWERS },
+        { "cherry-pick-rebase", test_cherry_pick_rebase, CHERRY_PICK_REBASE_ANSWERS },
+        { "tokenizer", test_tokenizer, TOKENIZER_ANSWERS },
+        { "log-range-merge-base", test_log_range_merge_base, LOG_RANGE_MERGE_BASE_ANSWERS },
+        { "file-history", test_file_history, FILE_HISTORY_ANSWERS },
+        { "snapshot-readers", test_snapshot_readers, SNAPSHOT_READERS_ANSWERS },
+        { "find-state", test_find_state, FIND_STATE_ANSWERS },
+        { "stat", test_stat, STAT_ANSWERS },
+        { "import", test_import, IMPORT_ANSWERS },
+    };
+    int failed = 0;
+    for (const Test& test : tests) {
+        string actual;
+        try {
+            actual = test.run_();
+        } catch (std::exception& e) {
+            actual = string("exception: ") + e.what() + '\n';
+        }
+        if (actual == test.expected_) {
+            cout << "PASS " << test.name_ << endl;
+        } else {
+            failed++;
+            cout << "FAIL " << test.name_ << "\n--- expected\n" << test.expected_
+                 << "--- actual\n" << actual << "---" << endl;
+        }
+    }
+    remove_scratch();
+    return failed ? 1 : 0;
+}
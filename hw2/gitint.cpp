@@ -1,7 +1,12 @@
 #include <iostream>
-#include <sstream>
 #include <algorithm>
+#include <charconv>
 #include <stdexcept>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <exception>
+#include <unistd.h>
 #include "gitint.h"
 
 using namespace std;
@@ -11,6 +16,205 @@ const std::string INVALID_COMMAND = "Invalid command";
 const std::string INVALID_OPTION = "Invalid option";
 const std::string INVALID_COMMIT_NUMBER = "Invalid commit number";
 const std::string LOG_COMMIT_STARTER = "Commit: ";
+const std::string NO_LOG_ATTACHED = "No repository log attached";
+const std::string LOG_ATTACHED = "Repository log already attached";
+const std::string LOG_CORRUPT = "Corrupt log file";
+const std::string UNCOMMITTED_CHANGES = "Uncommitted changes";
+const std::string STATS_DISABLED = "Statistics not compiled in";
+
+/*********************** Command line parsing *********************************/
+namespace {
+
+enum CommandWord {
+    CMD_UNKNOWN, CMD_QUIT, CMD_CREATE, CMD_EDIT, CMD_DISPLAY, CMD_ADD,
+    CMD_COMMIT, CMD_TAG, CMD_LOG, CMD_CHECKOUT, CMD_DIFF, CMD_SAVE,
+    CMD_OPEN, CMD_CHECKPOINT, CMD_MERGE_BASE, CMD_BRANCH, CMD_SWITCH,
+    CMD_MERGE, CMD_FIND_STATE, CMD_GC, CMD_STAT, CMD_IMPORT, CMD_CHERRY_PICK,
+    CMD_REBASE, CMD_STATS,
+    CMD_COUNT       // number of command words, not a command
+};
+
+/**
+ * Name of each CommandWord
+ */
+const char* const COMMAND_NAMES[CMD_COUNT] = {
+    "unknown", "quit", "create", "edit", "display", "add",
+    "commit", "tag", "log", "checkout", "diff", "save",
+    "open", "checkpoint", "merge-base", "branch", "switch",
+    "merge", "find-state", "gc", "stat", "import", "cherry-pick",
+    "rebase", "stats"
+};
+
+/**
+ * Maps a command word to its CommandWord. Length and first letter (plus
+ * one more letter for create/commit and save/stat) single out one
+ * candidate, so at most one string comparison is made.
+ */
+CommandWord command_word(std::string_view word)
+{
+    if (word.size() < 2) return CMD_UNKNOWN;
+    CommandWord cmd = CMD_UNKNOWN;
+    switch (word.size() << 8 | (unsigned char)word[0]) {
+    case 2 << 8 | 'g': cmd = CMD_GC; break;
+    case 3 << 8 | 'a': cmd = CMD_ADD; break;
+    case 3 << 8 | 'l': cmd = CMD_LOG; break;
+    case 3 << 8 | 't': cmd = CMD_TAG; break;
+    case 4 << 8 | 'd': cmd = CMD_DIFF; break;
+    case 4 << 8 | 'e': cmd = CMD_EDIT; break;
+    case 4 << 8 | 'o': cmd = CMD_OPEN; break;
+    case 4 << 8 | 'q': cmd = CMD_QUIT; break;
+    case 4 << 8 | 's': cmd = word[1] == 'a' ? CMD_SAVE : CMD_STAT; break;
+    case 5 << 8 | 'm': cmd = CMD_MERGE; break;
+    case 5 << 8 | 's': cmd = CMD_STATS; break;
+    case 6 << 8 | 'b': cmd = CMD_BRANCH; break;
+    case 6 << 8 | 'i': cmd = CMD_IMPORT; break;
+    case 6 << 8 | 'r': cmd = CMD_REBASE; break;
+    case 6 << 8 | 's': cmd = CMD_SWITCH; break;
+    case 6 << 8 | 'c': cmd = word[5] == 'e' ? CMD_CREATE : CMD_COMMIT; break;
+    case 7 << 8 | 'd': cmd = CMD_DISPLAY; break;
+    case 8 << 8 | 'c': cmd = CMD_CHECKOUT; break;
+    case 10 << 8 | 'c': cmd = CMD_CHECKPOINT; break;
+    case 10 << 8 | 'f': cmd = CMD_FIND_STATE; break;
+    case 10 << 8 | 'm': cmd = CMD_MERGE_BASE; break;
+    case 11 << 8 | 'c': cmd = CMD_CHERRY_PICK; break;
+    }
+    return word == COMMAND_NAMES[cmd] ? cmd : CMD_UNKNOWN;
+}
+
+/**
+ * Parses an optional sign and decimal digits at the start of `text`
+ * (std::from_chars does not take a leading '+')
+ *
+ * @returns characters used, 0 if `text` does not start with a number
+ */
+size_t parse_int(std::string_view text, int& value, bool& overflow)
+{
+    const char* first = text.data();
+    const char* last = first + text.size();
+    const char* p = first;
+    if (p != last && *p == '+') {
+        if (++p == last || *p < '0' || *p > '9') return 0;
+    }
+    std::from_chars_result res = std::from_chars(p, last, value);
+    if (res.ec == std::errc::invalid_argument) return 0;
+    overflow = res.ec == std::errc::result_out_of_range;
+    return res.ptr - first;
+}
+
+/**
+ * Reads `word` as a number the way std::stoi would, without throwing
+ * for words that are not numbers (tag names, filenames)
+ *
+ * @returns true if the word starts with a number
+ * @throws std::out_of_range if that number does not fit an int
+ */
+bool leading_int(std::string_view word, int& value)
+{
+    bool overflow = false;
+    if (parse_int(word, value, overflow) == 0) return false;
+    if (overflow) throw std::out_of_range("stoi");
+    return true;
+}
+
+/**
+ * Reads a whole word as a commit number; an empty word means `current`
+ */
+bool commit_ref(std::string_view word, CommitIdx current, CommitIdx& commit)
+{
+    bool overflow = false;
+    if (word.empty()) {
+        commit = current;
+        return true;
+    }
+    return parse_int(word, commit, overflow) == word.size() && !overflow;
+}
+
+/**
+ * Cursor over a command line that extracts words and numbers with the
+ * same rules as `std::istream >>`, as views into the line. As with a
+ * stream, once an extraction fails all later ones fail too.
+ */
+class CommandReader {
+public:
+    explicit CommandReader(std::string_view line) : line_(line), at_(0), failed_(false) {}
+
+    /** Next whitespace-delimited word */
+    bool word(std::string_view& out) {
+        skip_space();
+        size_t start = at_;
+        while (at_ < line_.size() && !is_space(line_[at_])) at_++;
+        if (at_ == start) failed_ = true;
+        if (failed_) return false;
+        out = line_.substr(start, at_ - start);
+        return true;
+    }
+
+    /** Number at the next non-blank; stops at the first non-digit */
+    bool number(int& out) {
+        skip_space();
+        bool overflow = false;
+        size_t used = failed_ ? 0 : parse_int(line_.substr(at_), out, overflow);
+        if (used == 0 || overflow) failed_ = true;
+        if (failed_) return false;
+        at_ += used;
+        return true;
+    }
+
+    /** Everything after the last extraction */
+    std::string_view rest() const {
+        return line_.substr(at_);
+    }
+
+private:
+    static bool is_space(char c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    void skip_space() {
+        while (at_ < line_.size() && is_space(line_[at_])) at_++;
+    }
+
+    std::string_view line_;
+    size_t at_;
+    bool failed_;
+};
+
+}
+
+/*********************** Keyframe cache defaults ******************************/
+const size_t DEFAULT_KEYFRAME_INTERVAL = 1;           // trees are shared
+const size_t DEFAULT_KEYFRAME_BUDGET = 256u << 20;    // 256 MiB
+
+// Commits at multiples of this depth carry their full state for readers
+// of snapshots, who otherwise replay history from "init"
+const int PUBLISHED_STATE_INTERVAL = 64;
+
+/*********************** Per-file history *************************************/
+// Touches from other branches skipped before falling back to a rebuild
+const size_t HISTORY_SCAN_LIMIT = 32;
+
+/*********************** Diff composition *************************************/
+// Fewest commits worth handing to a composing thread of their own
+const size_t COMPOSE_SLICE = 256;
+
+namespace {
+
+/**
+ * Sorts files by id and adds up the entries of each file into one
+ */
+void sum_by_file(FileVec& files)
+{
+    std::stable_sort(files.begin(), files.end(),
+        [](const FileEntry& a, const FileEntry& b) { return a.name_ < b.name_; });
+    size_t out = 0;
+    for(size_t i = 0; i < files.size(); i++) {
+        if(out > 0 && files[out - 1].name_ == files[i].name_) files[out - 1].value_ += files[i].value_;
+        else files[out++] = files[i];
+    }
+    files.resize(out);
+}
+
+}
 
 
 
@@ -18,71 +222,105 @@ const std::string LOG_COMMIT_STARTER = "Commit: ";
 
 void GitInt::print_menu() const
 {
-    cout << "Menu:                          " << endl;
-    cout << "===============================" << endl;
-    cout << "create   filename int-value    " << endl;
-    cout << "edit     filename int-value    " << endl;
-    cout << "display  (filename)            " << endl;
-    cout << "display  commit-num            " << endl;
-    cout << "add      file1 (file2 ...)     " << endl;
-    cout << "commit   \"log-message\"       " << endl;
-    cout << "tag      (-a tag-name)         " << endl;
-    cout << "log                            " << endl;
-    cout << "checkout commit-num/tag-name   " << endl;
-    cout << "diff                           " << endl;
-    cout << "diff     commit                " << endl;
-    cout << "diff     commit-n commit-m     " << endl;
-}
-
-
-bool GitInt::process_command(std::string cmd_line)
+    cout << "Menu:                          " << '\n';
+    cout << "===============================" << '\n';
+    cout << "create   filename int-value    " << '\n';
+    cout << "edit     filename int-value    " << '\n';
+    cout << "display  (filename)            " << '\n';
+    cout << "display  commit-num            " << '\n';
+    cout << "display  filename@commit-num   " << '\n';
+    cout << "add      file1 (file2 ...)     " << '\n';
+    cout << "commit   \"log-message\"       " << '\n';
+    cout << "tag      (-a tag-name)         " << '\n';
+    cout << "log                            " << '\n';
+    cout << "log      -n count              " << '\n';
+    cout << "log      commit-a..commit-b    " << '\n';
+    cout << "log      -- filename           " << '\n';
+    cout << "merge-base commit-a commit-b   " << '\n';
+    cout << "branch   (branch-name)         " << '\n';
+    cout << "switch   branch-name           " << '\n';
+    cout << "merge    branch-name/commit    " << '\n';
+    cout << "cherry-pick commit/from..to    " << '\n';
+    cout << "rebase   from..to onto commit  " << '\n';
+    cout << "checkout commit-num/tag-name   " << '\n';
+    cout << "gc       (--squash age)        " << '\n';
+    cout << "diff                           " << '\n';
+    cout << "diff     commit                " << '\n';
+    cout << "diff     commit-n commit-m     " << '\n';
+    cout << "find-state (commit)            " << '\n';
+    cout << "stat     (commit)              " << '\n';
+    cout << "stats                          " << '\n';
+    cout << "import   filename              " << '\n';
+    cout << "save     filename              " << '\n';
+    cout << "open     filename              " << '\n';
+    cout << "checkpoint                     " << '\n';
+}
+
+
+bool GitInt::process_command(std::string_view cmd_line)
 {
     bool quit = false;
-    std::stringstream ss(cmd_line);
-    std::string cmd;
-    ss >> cmd;
-    if (ss.fail()) throw std::runtime_error(INVALID_COMMAND);
+    CommandReader in(cmd_line);
+    std::string_view cmd;
+    if (!in.word(cmd)) throw std::runtime_error(INVALID_COMMAND);
+    CommandWord word = command_word(cmd);
+#ifdef GITINT_STATS
+    // Before the timer starts, so the dump counts towards no command
+    if (stats_.dump_due()) stats_.dump(gauges());
+    Instrumentation::Scope scope(stats_, word);
+#endif
 
-    if (cmd == "quit") {
+    switch (word) {
+    case CMD_QUIT:
         quit = true;
-    } else if(cmd == "create") {
-        std::string filename;
+        break;
+    case CMD_CREATE: {
+        std::string_view filename;
         int value;
-        if(ss >> filename && ss >> value) {
+        if(in.word(filename) && in.number(value)) {
             create(filename, value);
         } else {
             throw std::invalid_argument(INVALID_COMMAND);
         }
-    } else if(cmd == "edit") {
-        std::string filename;
+        break;
+    }
+    case CMD_EDIT: {
+        std::string_view filename;
         int value;
-        if(ss >> filename && ss >> value) {
+        if(in.word(filename) && in.number(value)) {
             edit(filename, value);
         } else {
             throw std::invalid_argument(INVALID_COMMAND);
         }
-    } else if(cmd == "display") {
-        string filename;
-        int index = 0, flag = 0;
-        if(ss >> filename) {
-            try {
-                index = stoi(filename);
-                flag = 1;
-            } catch (std::invalid_argument& e) {
-                display(filename);
-            }
-            if(flag) display_commit(index);
+        break;
+    }
+    case CMD_DISPLAY: {
+        std::string_view filename;
+        int index;
+        size_t at;
+        CommitIdx commit;
+        if(in.word(filename)) {
+            // A working file's own name wins over reading it as file@N
+            if((at = filename.rfind('@')) != std::string_view::npos &&
+                    !working_file(names_.find(filename)) &&
+                    commit_ref(filename.substr(at + 1), current, commit)) {
+                display(filename.substr(0, at), commit);
+            } else if(leading_int(filename, index)) display_commit(index);
+            else display(filename);
         } else {
             display_all();
         }
-    } else if(cmd == "add") {
-        string filename;
-        while(ss >> filename) {
+        break;
+    }
+    case CMD_ADD: {
+        std::string_view filename;
+        while(in.word(filename)) {
             add(filename);
         }
-    } else if(cmd == "commit") {
-        string message;
-        getline(ss, message);
+        break;
+    }
+    case CMD_COMMIT: {
+        std::string_view message = in.rest();
         size_t start = message.find_first_of('\"');
         if(start == string::npos) {
             throw runtime_error(INVALID_COMMAND);
@@ -94,46 +332,177 @@ bool GitInt::process_command(std::string cmd_line)
         }
         message = message.substr(0,end);
         commit(message);
-    } else if(cmd == "tag") {
-        string option, tagname;
-        if(ss >> option) {
+        break;
+    }
+    case CMD_TAG: {
+        std::string_view option, tagname;
+        if(in.word(option)) {
             if(option == "-a") {
-                if(ss >> tagname)  create_tag(tagname,current);
+                if(in.word(tagname))  create_tag(tagname,current);
                 else throw runtime_error(INVALID_COMMAND);
             } else throw runtime_error(INVALID_COMMAND);
 
         } else {
             tags();
         }
-    } else if(cmd == "log") {
-        log();
-    } else if(cmd == "checkout") {
-        string tagname;
-        int flag = 0, tag = 0;
-        if(ss >> tagname) {
-            try {
-                tag = stoi(tagname);
-                flag = 1;
-            } catch (std::invalid_argument &e) {
-                checkout(tagname);
+        break;
+    }
+    case CMD_LOG: {
+        std::string_view option;
+        int count;
+        size_t dots;
+        if(!in.word(option)) {
+            log();
+        } else if(option == "-n") {
+            if(in.number(count) && count >= 0) log((size_t)count);
+            else throw runtime_error(INVALID_COMMAND);
+        } else if((dots = option.find("..")) != std::string_view::npos) {
+            CommitIdx from, to;
+            if(commit_ref(option.substr(0, dots), current, from) &&
+                    commit_ref(option.substr(dots + 2), current, to)) {
+                log(from, to);
+            } else {
+                throw runtime_error(INVALID_COMMAND);
             }
-            if(flag) checkout(tag);
+        } else if(option == "--") {
+            std::string_view filename;
+            if(in.word(filename)) log(filename);
+            else throw runtime_error(INVALID_COMMAND);
+        } else {
+            // Other trailing words have always been ignored
+            log();
+        }
+        break;
+    }
+    case CMD_MERGE_BASE: {
+        int commit1, commit2;
+        if(in.number(commit1) && in.number(commit2)) merge_base(commit1, commit2);
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_CHECKOUT: {
+        std::string_view tagname;
+        int tag;
+        if(in.word(tagname)) {
+            if(leading_int(tagname, tag)) checkout(tag);
+            else checkout(tagname);
         } else {
             throw runtime_error(INVALID_COMMAND);
         }
-    } else if(cmd == "diff") {
+        break;
+    }
+    case CMD_DIFF: {
         int commit1, commit2;
-        if(ss >> commit1) {
-            if(ss >> commit2) {
+        if(in.number(commit1)) {
+            if(in.number(commit2)) {
                 if(commit1 < commit2) throw invalid_argument(INVALID_COMMAND);
                 diff(commit1, commit2);
             } else {
                 diff(commit1);
             }
         } else {
-            display_helper(diff_helper(currentFiles,untracked));
+            display_helper(working_changes());
         }
-    } else {
+        break;
+    }
+    case CMD_STAT: {
+        std::string_view word;
+        CommitIdx commit;
+        if(!in.word(word)) stat();
+        else if(commit_ref(word, current, commit)) stat(commit);
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_GC: {
+        std::string_view option;
+        int age;
+        if(!in.word(option)) gc(-1);
+        else if(option == "--squash" && in.number(age) && age >= 0) gc(age);
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_FIND_STATE: {
+        std::string_view word;
+        CommitIdx commit;
+        if(!in.word(word)) find_state();
+        else if(commit_ref(word, current, commit)) find_state(commit);
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_IMPORT: {
+        std::string_view path;
+        if(in.word(path)) import(string(path));
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_SAVE: {
+        std::string_view path;
+        if(in.word(path)) save(string(path));
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_OPEN: {
+        std::string_view path;
+        if(in.word(path)) open(string(path));
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_CHECKPOINT:
+        checkpoint();
+        break;
+    case CMD_STATS:
+        stats();
+        break;
+    case CMD_BRANCH: {
+        std::string_view name;
+        if(in.word(name)) create_branch(name, current);
+        else branches();
+        break;
+    }
+    case CMD_SWITCH: {
+        std::string_view name;
+        if(in.word(name)) switch_branch(name);
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_MERGE: {
+        std::string_view name;
+        if(in.word(name)) merge(name);
+        else throw runtime_error(INVALID_COMMAND);
+        break;
+    }
+    case CMD_CHERRY_PICK: {
+        std::string_view range;
+        size_t dots;
+        CommitIdx from, to;
+        if(!in.word(range)) {
+            throw runtime_error(INVALID_COMMAND);
+        } else if((dots = range.find("..")) != std::string_view::npos) {
+            if(commit_ref(range.substr(0, dots), current, from) &&
+                    commit_ref(range.substr(dots + 2), current, to)) {
+                cherry_pick(from, to);
+            } else {
+                throw runtime_error(INVALID_COMMAND);
+            }
+        } else if(commit_ref(range, current, to)) {
+            cherry_pick(to);
+        } else {
+            throw runtime_error(INVALID_COMMAND);
+        }
+        break;
+    }
+    case CMD_REBASE: {
+        std::string_view range, keyword, onto;
+        size_t dots;
+        if(in.word(range) && (dots = range.find("..")) != std::string_view::npos &&
+                in.word(keyword) && keyword == "onto" && in.word(onto)) {
+            rebase(range.substr(0, dots), range.substr(dots + 2), onto);
+        } else {
+            throw runtime_error(INVALID_COMMAND);
+        }
+        break;
+    }
+    default:
         throw runtime_error(INVALID_COMMAND);
     }
 
@@ -146,173 +515,1149 @@ void GitInt::display_commit(CommitIdx commit) const
     if ( false == valid_commit(commit) ) {
         throw std::invalid_argument(INVALID_COMMIT_NUMBER);
     }
-    display_helper(commits_[commit].diffs_);
+    display_helper(commits_.diffs(commit));
 }
 
 
-void GitInt::display_helper(const std::map<std::string, int>& dat) const
+void GitInt::display_helper(DiffView dat) const
 {
-    for (std::map<std::string, int>::const_iterator cit = dat.begin();
-            cit != dat.end();
-            ++cit) {
-        std::cout << cit->first << " : " << cit->second << std::endl;
-    }
+    write_files(std::cout, names_, dat);
 }
 
 
-void GitInt::log_helper(CommitIdx commit_num, const std::string& log_message) const
+void GitInt::log_helper(CommitIdx commit_num, std::string_view log_message) const
 {
-    std::cout << LOG_COMMIT_STARTER << commit_num << std::endl;
-    std::cout << log_message << std::endl << std::endl;
+    std::cout << LOG_COMMIT_STARTER << commit_num << '\n';
+    std::cout << log_message << "\n\n";
 
 }
 
-void GitInt::create(const std::string &filename, int value) {
-    if(untracked.find(filename) != untracked.end()) {
+void GitInt::create(std::string_view filename, int value) {
+    NameId id = names_.intern(filename);
+    if(working_file(id)) {
         throw std::invalid_argument(INVALID_COMMAND);
     }
-    untracked[filename] = value;
+    overlay_[id] = value;
+    changes_stale_ = true;
+    worktree_stale_ = true;
+    log_record(WriteAheadLog::CREATE, filename, value);
 }
 
-void GitInt::edit(const std::string &filename, int value) {
-    if(untracked.find(filename) == untracked.end()) {
+void GitInt::edit(std::string_view filename, int value) {
+    NameId id = names_.find(filename);
+    if(!working_file(id)) {
         throw std::invalid_argument(INVALID_COMMAND);
     }
-    untracked[filename] = value;
+    overlay_[id] = value;
+    changes_stale_ = true;
+    worktree_stale_ = true;
+    log_record(WriteAheadLog::EDIT, filename, value);
 }
 
-void GitInt::display(const std::string &filename) const {
-    if(untracked.find(filename) == untracked.end()) {
+void GitInt::display(std::string_view filename) const {
+    const int* value = working_file(names_.find(filename));
+    if(!value) {
+        throw std::invalid_argument(INVALID_COMMAND);
+    }
+    cout << *value << '\n';
+}
+
+void GitInt::display(std::string_view filename, CommitIdx commit) const {
+    if(commit < 0 || commit >= commits_.size()) {
+        throw std::invalid_argument(INVALID_COMMIT_NUMBER);
+    }
+    int value;
+    index_history();
+    if(!value_at(names_.find(filename), commit, value)) {
         throw std::invalid_argument(INVALID_COMMAND);
     }
-    cout << untracked.at(filename) << endl;
+    cout << value << '\n';
 }
 
 void GitInt::display_all() const {
-    display_helper(untracked);
+    display_helper(working_tree().to_vec());
 }
 
-void GitInt::add(std::string filename) {
-    if(untracked.find(filename) == untracked.end()) {
+void GitInt::add(std::string_view filename) {
+    NameId id = names_.find(filename);
+    if(!working_file(id)) {
         throw std::invalid_argument(INVALID_COMMAND);
     }
-    stages.insert(filename);
+    stages.push_back(id);
+    log_record(WriteAheadLog::ADD, filename);
 }
 
-void GitInt::commit(std::string message) {
+void GitInt::commit(std::string_view message) {
     if(stages.empty()) throw runtime_error("");
 
-    std::map<std::string, int> temp;
-    std::map<std::string, int> newFiles = currentFiles;
-    for(const string& file : stages) {
-        if(untracked.find(file) != untracked.end()) {
-            temp[file] = untracked[file];
-            newFiles[file] = untracked[file];
-        }
+    sort(stages.begin(), stages.end());
+    stages.erase(unique(stages.begin(), stages.end()), stages.end());
+    // A staged file contributes only if it has changed, so the commit is
+    // the staged part of the working changes (both sorted by id)
+    const FileVec& changes = working_changes();
+    FileVec diffs;
+    std::vector<NameId>::const_iterator staged = stages.begin();
+    for(const FileEntry& change : changes) {
+        while(staged != stages.end() && *staged < change.name_) ++staged;
+        if(staged == stages.end()) break;
+        if(*staged == change.name_) diffs.push_back(change);
     }
     stages.clear();
-    const std::map<std::string, int>& diffs = diff_helper(currentFiles, temp);
-    commits_.emplace_back(message, diffs, current);
-    current = commits_.size()-1;
-    currentFiles = newFiles;
+    append_commit(message, diffs, -1);
+    // The working files are unchanged; the committed ones now match the
+    // base and need no overlay entry
+    for(const FileEntry& file : diffs) overlay_.erase(file.name_);
+    changes_stale_ = true;
+    log_record(WriteAheadLog::COMMIT, message);
+}
+
+void GitInt::append_commit(std::string_view message, const FileVec& diffs, CommitIdx parent2) {
+    int depth = commits_.depth(current) + 1;
+    sync_values();      // also builds currentFiles, updated in place below
+    for(const FileEntry& file : diffs) {
+        const int* old = currentFiles.find(file.name_);
+        if(old) values_.erase(*old);
+        values_.insert(old ? *old + file.value_ : file.value_);
+    }
+    size_t bytes = currentFiles.apply(diffs);
+    values_files_ = currentFiles;
+    current = commits_.append(message, diffs, current, depth, currentFiles.hash(), values_.stats(),
+                              parent2, depth % PUBLISHED_STATE_INTERVAL == 0 ? &currentFiles : NULL);
+    max_depth_ = max(max_depth_, depth);
+    cache_keyframe(current, currentFiles, bytes);
+    if(history_upto_ == current) {
+        // Index as we go; the new contents are at hand
+        for(const FileEntry& file : diffs) {
+            if(file.name_ >= history_.size()) history_.resize(file.name_ + 1);
+            FileTouch touch = { current, *currentFiles.find(file.name_) };
+            history_[file.name_].push_back(touch);
+        }
+        history_upto_++;
+    }
+    if(!branch_.empty()) branches_[branch_] = current;
 }
 
-void GitInt::create_tag(const std::string &tagname, CommitIdx commit) {
+void GitInt::create_tag(std::string_view tagname, CommitIdx commit) {
     if(tags_map.find(tagname) != tags_map.end()) {
         throw invalid_argument(INVALID_COMMAND);
     }
-    tags_map[tagname] = commit;
+    tags_map.emplace(tagname, commit);
     tags_.emplace_back(tagname);
+    log_record(WriteAheadLog::TAG, tagname, commit);
 }
 
 void GitInt::tags() const {
     vector<string>::const_iterator it = tags_.begin();
     while(it < tags_.end()) {
-        cout << (*it) << endl;
+        cout << (*it) << '\n';
         it++;
     }
 }
 
 bool GitInt::checkout(CommitIdx commitIndex) {
     if(valid_commit(commitIndex)) {
-        currentFiles = checkout_helper(commitIndex);
-        untracked = currentFiles;
-        current = commitIndex;
+        move_head(commitIndex);
+        branch_.clear();
+        log_record(WriteAheadLog::CHECKOUT, std::string_view(), commitIndex);
         return true;
     }
     throw invalid_argument(INVALID_COMMAND);
 }
 
-bool GitInt::checkout(std::string tag) {
-    if(tags_map.find(tag) != tags_map.end())
-        return checkout(tags_map[tag]);
+bool GitInt::checkout(std::string_view tag) {
+    std::map<std::string, int, std::less<> >::const_iterator it = tags_map.find(tag);
+    if(it != tags_map.end())
+        return checkout(it->second);
     throw invalid_argument(INVALID_COMMAND);
 }
 
+void GitInt::move_head(CommitIdx commitIdx) {
+    current = commitIdx;
+    files_pending_ = true;
+    reset_overlay();
+}
+
+const FileTree& GitInt::base_files() const {
+    if(files_pending_) {
+        currentFiles = checkout_helper(current);
+        files_pending_ = false;
+    }
+    return currentFiles;
+}
+
+const int* GitInt::working_file(NameId id) const {
+    std::map<NameId, int>::const_iterator it = overlay_.find(id);
+    if(it != overlay_.end()) return &it->second;
+    return base_files().find(id);
+}
+
+const FileTree& GitInt::working_tree() const {
+    if(worktree_stale_) {
+        worktree_ = base_files();
+        for(const std::pair<const NameId, int>& file : overlay_) worktree_.set(file.first, file.second);
+        worktree_stale_ = false;
+    }
+    return worktree_;
+}
+
+void GitInt::reset_overlay() {
+    overlay_.clear();
+    changes_.clear();
+    changes_stale_ = false;
+    worktree_stale_ = true;
+}
+
+void GitInt::sync_values() const {
+    // Same files, perhaps a shared keyframe's copy (compared in full, as
+    // equal hashes could be a collision)
+    if(values_files_ == base_files()) {
+        values_files_ = currentFiles;
+        return;
+    }
+    const FileTree& from = values_files_;
+    const FileTree& to = currentFiles;
+    for(const FileEntry& file : FileTree::diff(from, to)) {
+        const int* old = from.find(file.name_);
+        if(old) values_.erase(*old);
+        values_.insert(*to.find(file.name_));
+    }
+    // Files `to` does not have at all
+    for(const FileEntry& file : FileTree::diff(to, from)) {
+        if(!to.find(file.name_)) values_.erase(*from.find(file.name_));
+    }
+    values_files_ = currentFiles;
+}
+
+void GitInt::create_branch(std::string_view name, CommitIdx commit) {
+    if(branches_.find(name) != branches_.end()) {
+        throw invalid_argument(INVALID_COMMAND);
+    }
+    branches_.emplace(name, commit);
+    log_record(WriteAheadLog::BRANCH, name, commit);
+}
+
+void GitInt::branches() const {
+    for(const std::pair<const std::string, CommitIdx>& branch : branches_) {
+        cout << (branch.first == branch_ ? "* " : "  ") << branch.first << '\n';
+    }
+}
+
+bool GitInt::switch_branch(std::string_view name) {
+    std::map<std::string, CommitIdx, std::less<> >::const_iterator it = branches_.find(name);
+    if(it == branches_.end()) {
+        throw invalid_argument(INVALID_COMMAND);
+    }
+    move_head(it->second);
+    branch_ = it->first;
+    log_record(WriteAheadLog::SWITCH, name);
+    return true;
+}
+
+void GitInt::merge(std::string_view name) {
+    merge_helper(name, true);
+    log_record(WriteAheadLog::MERGE, name);
+}
+
+void GitInt::merge_helper(std::string_view name, bool report) {
+    CommitIdx theirs = resolve_ref(name);
+    if(!stages.empty() || !working_changes().empty()) {
+        throw runtime_error(UNCOMMITTED_CHANGES);
+    }
+
+    std::vector<CommitIdx> ours_only, theirs_only;
+    CommitIdx base = commits_.split(current, theirs, &ours_only, &theirs_only);
+    if(theirs_only.empty()) {
+        if(report) cout << "Already up to date" << '\n';
+    } else if(ours_only.empty()) {
+        move_head(theirs);
+        if(!branch_.empty()) branches_[branch_] = current;
+        if(report) cout << "Fast-forward" << '\n';
+    } else {
+        // Sum the changes of every commit only they have
+        FileVec delta = compose_diffs(theirs_only);
+
+        if(report) {
+            // Files both sides changed since the merge base
+            FileTree base_state = checkout_helper(base);
+            std::vector<const FileEntry*> conflicts;
+            for(const FileEntry& file : delta) {
+                const int* before = base_state.find(file.name_);
+                const int* ours = base_files().find(file.name_);
+                bool theirs_changed = file.value_ != 0 || !before;
+                bool ours_changed = (ours == NULL) != (before == NULL) || (ours && *ours != *before);
+                if(theirs_changed && ours_changed) conflicts.push_back(&file);
+            }
+            std::sort(conflicts.begin(), conflicts.end(),
+                [this](const FileEntry* a, const FileEntry* b) {
+                    return names_.name(a->name_) < names_.name(b->name_);
+                });
+            for(const FileEntry* file : conflicts) {
+                const int* before = base_state.find(file->name_);
+                cout << "Conflict: " << names_.name(file->name_) << " : "
+                     << *currentFiles.find(file->name_) - (before ? *before : 0)
+                     << " + " << file->value_ << '\n';
+            }
+        }
+
+        FileTree merged = base_files();
+        merged.apply(delta);
+        string message = "Merge ";
+        message.append(name.data(), name.size());
+        append_commit(message, FileTree::diff(currentFiles, merged), theirs);
+        reset_overlay();
+    }
+}
+
+CommitIdx GitInt::resolve_ref(std::string_view name) const {
+    std::map<std::string, CommitIdx, std::less<> >::const_iterator it = branches_.find(name);
+    if(it != branches_.end()) return it->second;
+    CommitIdx commit;
+    if(!commit_ref(name, current, commit) || commit < 0 || commit >= commits_.size()) {
+        throw invalid_argument(INVALID_COMMAND);
+    }
+    return commit;
+}
+
+FileVec GitInt::compose_diffs(const std::vector<CommitIdx>& commits) const {
+    // One slice per thread, each at least COMPOSE_SLICE commits long
+    size_t slices = max((size_t)1, min(compose_threads_, commits.size() / COMPOSE_SLICE));
+    size_t per = (commits.size() + slices - 1) / max((size_t)1, slices);
+    std::vector<FileVec> sums(slices);
+    std::vector<std::exception_ptr> errors(slices);
+    std::vector<std::thread> workers;
+    // Committed history is only read here, and the table is safe to read
+    // from several threads while nothing is appended
+    auto compose = [&](size_t slice) {
+        try {
+            FileVec& sum = sums[slice];
+            size_t end = min(commits.size(), (slice + 1) * per);
+            for(size_t i = slice * per; i < end; i++) {
+                if(commits_.parent2(commits[i]) >= 0) continue;
+                DiffView diffs = commits_.diffs(commits[i]);
+                sum.insert(sum.end(), diffs.begin(), diffs.end());
+            }
+            sum_by_file(sum);
+        } catch(...) {
+            errors[slice] = std::current_exception();
+        }
+    };
+    for(size_t slice = 1; slice < slices; slice++) workers.emplace_back(compose, slice);
+    compose(0);
+    for(std::thread& worker : workers) worker.join();
+    for(const std::exception_ptr& error : errors) {
+        if(error) std::rethrow_exception(error);
+    }
+
+    FileVec& delta = sums[0];
+    for(size_t slice = 1; slice < slices; slice++) {
+        delta.insert(delta.end(), sums[slice].begin(), sums[slice].end());
+    }
+    if(slices > 1) sum_by_file(delta);
+    return std::move(delta);
+}
+
+void GitInt::apply_commit(std::string_view message, DiffView delta) {
+    FileTree picked = base_files();
+    picked.apply(delta);
+    append_commit(message, FileTree::diff(currentFiles, picked), -1);
+}
+
+void GitInt::cherry_pick(CommitIdx commit) {
+    if(!valid_commit(commit)) throw invalid_argument(INVALID_COMMAND);
+    if(!stages.empty() || !working_changes().empty()) {
+        throw runtime_error(UNCOMMITTED_CHANGES);
+    }
+    apply_commit(commits_.message(commit), commits_.diffs(commit));
+    reset_overlay();
+    log_record(WriteAheadLog::CHERRY_PICK, std::string_view(), commit);
+}
+
+void GitInt::cherry_pick(CommitIdx from, CommitIdx to) {
+    if(from < 0 || from >= commits_.size() || to < 0 || to >= commits_.size()) {
+        throw invalid_argument(INVALID_COMMAND);
+    }
+    if(!stages.empty() || !working_changes().empty()) {
+        throw runtime_error(UNCOMMITTED_CHANGES);
+    }
+    std::vector<CommitIdx> picks;
+    commits_.split(from, to, NULL, &picks);
+    string message = "Cherry-pick " + to_string(from) + ".." + to_string(to);
+    apply_commit(message, compose_diffs(picks));
+    reset_overlay();
+    log_record(WriteAheadLog::CHERRY_PICK, to_string(from), to);
+}
+
+void GitInt::rebase(std::string_view from, std::string_view to, std::string_view onto) {
+    CommitIdx base = resolve_ref(from);
+    CommitIdx tip = resolve_ref(to);
+    CommitIdx target = resolve_ref(onto);
+    if(!stages.empty() || !working_changes().empty()) {
+        throw runtime_error(UNCOMMITTED_CHANGES);
+    }
+    string branch;
+    if(to.empty()) branch = branch_;
+    else if(branches_.find(to) != branches_.end()) branch = to;
+
+    std::vector<CommitIdx> picks;     // newest first
+    commits_.split(base, tip, NULL, &picks);
+    move_head(target);
+    branch_ = branch;
+    if(!branch_.empty()) branches_[branch_] = current;
+    for(std::vector<CommitIdx>::reverse_iterator it = picks.rbegin(); it != picks.rend(); ++it) {
+        if(commits_.parent2(*it) >= 0) continue;
+        apply_commit(commits_.message(*it), commits_.diffs(*it));
+    }
+    reset_overlay();
+
+    string text;
+    text.append(from.data(), from.size()).append(1, ' ');
+    text.append(to.data(), to.size()).append(1, ' ');
+    text.append(onto.data(), onto.size());
+    log_record(WriteAheadLog::REBASE, text);
+}
+
+void GitInt::gc(int squash_age) {
+    gc_helper(squash_age, true);
+    log_record(WriteAheadLog::GC, "", squash_age);
+}
+
+void GitInt::gc_helper(int squash_age, bool report) {
+    enum { DROP, KEEP, SQUASH };
+    CommitIdx size = commits_.size();
+    size_t before = report ? commits_.encoded_bytes() : 0;
+
+    // Mark everything reachable from the roots
+    std::vector<unsigned char> mark(size, DROP);
+    std::vector<bool> root(size, false);
+    std::vector<CommitIdx> pending(1, current);
+    for(const std::pair<const std::string, int>& tag : tags_map) pending.push_back(tag.second);
+    for(const std::pair<const std::string, CommitIdx>& branch : branches_) pending.push_back(branch.second);
+    for(CommitIdx commit : pending) root[commit] = true;
+    while(!pending.empty()) {
+        CommitIdx commit = pending.back();
+        pending.pop_back();
+        if(commit < 0 || mark[commit] != DROP) continue;
+        mark[commit] = KEEP;
+        pending.push_back(commits_.parent(commit));
+        pending.push_back(commits_.parent2(commit));
+    }
+    CommitIdx dropped = count(mark.begin(), mark.end(), DROP);
+
+    // A run's last commit takes over the changes of the commits before
+    // it, so those may go if they lead nowhere else
+    CommitIdx squashed = 0;
+    if(squash_age >= 0) {
+        CommitIdx old = size - squash_age;     // commits below this are old
+        std::vector<int> children(size, 0);
+        std::vector<CommitIdx> child(size, -1);
+        std::vector<bool> merged_in(size, false);
+        for(CommitIdx commit = 1; commit < size; commit++) {
+            if(mark[commit] != KEEP) continue;
+            children[commits_.parent(commit)]++;
+            child[commits_.parent(commit)] = commit;
+            if(commits_.parent2(commit) >= 0) merged_in[commits_.parent2(commit)] = true;
+        }
+        for(CommitIdx commit = 1; commit < old; commit++) {
+            if(mark[commit] == KEEP && !root[commit] && !merged_in[commit] &&
+                    commits_.parent2(commit) < 0 && children[commit] == 1 &&
+                    child[commit] < old && commits_.parent2(child[commit]) < 0) {
+                mark[commit] = SQUASH;
+                squashed++;
+            }
+        }
+    }
+
+    // Copy what is kept, in order, so parents still come first
+    CommitTable compacted;
+    std::vector<CommitIdx> remap(size, -1);
+    remap[0] = 0;
+    int max_depth = 0;
+    for(CommitIdx commit = 1; dropped + squashed > 0 && commit < size; commit++) {
+        if(mark[commit] != KEEP) continue;
+        CommitIdx parent = commits_.parent(commit);
+        while(mark[parent] == SQUASH) parent = commits_.parent(parent);
+        int depth = compacted.depth(remap[parent]) + 1;
+        max_depth = max(max_depth, depth);
+        FileVec composite;
+        DiffView diffs = commits_.diffs(commit);
+        if(parent != commits_.parent(commit)) {
+            composite = FileTree::diff(checkout_helper(parent), checkout_helper(commit));
+            diffs = composite;
+        }
+        FileTree state;
+        if(depth % PUBLISHED_STATE_INTERVAL == 0) state = checkout_helper(commit);
+        CommitIdx parent2 = commits_.parent2(commit);
+        remap[commit] = compacted.append(commits_.message(commit), diffs, remap[parent], depth,
+                                         commits_.hash(commit), commits_.stats(commit),
+                                         parent2 >= 0 ? remap[parent2] : -1,
+                                         depth % PUBLISHED_STATE_INTERVAL == 0 ? &state : NULL);
+    }
+
+    if(dropped + squashed > 0) {
+        // Keyframes of kept commits stay valid: squashing changes diffs,
+        // never a commit's state
+        std::map<CommitIdx, Keyframe> keyframes;
+        for(std::pair<const CommitIdx, Keyframe>& kf : keyframes_) {
+            if(remap[kf.first] < 0) {
+                keyframe_bytes_ -= kf.second.bytes_;
+                keyframe_lru_.erase(kf.second.lru_);
+                continue;
+            }
+            *kf.second.lru_ = remap[kf.first];
+            keyframes.emplace(remap[kf.first], kf.second);
+        }
+        keyframes_.swap(keyframes);
+        std::unordered_map<uint64_t, CommitIdx>::iterator state = keyframe_states_.begin();
+        while(state != keyframe_states_.end()) {
+            if(remap[state->second] < 0) {
+                state = keyframe_states_.erase(state);
+            } else {
+                state->second = remap[state->second];
+                ++state;
+            }
+        }
+
+        commits_.replace(compacted);
+        current = remap[current];
+        for(std::pair<const std::string, int>& tag : tags_map) tag.second = remap[tag.second];
+        for(std::pair<const std::string, CommitIdx>& branch : branches_) {
+            branch.second = remap[branch.second];
+        }
+        max_depth_ = max_depth;
+        history_.clear();
+        history_upto_ = 0;
+        states_.clear();
+        states_upto_ = 0;
+    }
+
+    if(report) {
+        size_t after = commits_.encoded_bytes();
+        cout << "Removed " << dropped << " unreachable and " << squashed << " squashed commits; "
+             << "reclaimed " << (before > after ? before - after : 0) << " bytes (messages and diffs " << before
+             << " -> " << after << " bytes, commits " << size << " -> " << commits_.size() << ")"
+             << '\n';
+    }
+}
+
+void GitInt::import(const std::string& path) {
+    if(!stages.empty() || !working_changes().empty()) {
+        throw runtime_error(UNCOMMITTED_CHANGES);
+    }
+    ImportReader reader;
+    reader.open(path);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point shown = start;
+    size_t records = 0;
+    CommitIdx first = commits_.size();
+    std::string key;            // commit whose records are being collected
+    FileVec files;
+    std::string error;
+    try {
+        ImportBatch batch;
+        while(reader.next(batch)) {
+            for(const ImportRecord& record : batch.records_) {
+                if(record.commit_ != key) {
+                    import_commit(key, files);
+                    key.assign(record.commit_.data(), record.commit_.size());
+                }
+                files.push_back(FileEntry(names_.intern(record.file_), record.value_));
+            }
+            records += batch.records_.size();
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if(now - shown >= chrono::seconds(1)) {
+                double secs = chrono::duration<double>(now - start).count();
+                cerr << "import: " << records << " records, " << commits_.size() - first
+                     << " commits, " << reader.bytes() << " bytes ("
+                     << records / secs << " records/sec)" << endl;
+                shown = now;
+            }
+        }
+        import_commit(key, files);
+    } catch(std::runtime_error& e) {
+        // Keep what was committed; the commit cut short is dropped
+        error = e.what();
+    }
+    reset_overlay();
+
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "import: " << records << " records, " << reader.bytes() << " bytes in " << secs
+         << " s (" << (secs > 0 ? records / secs : 0.0) << " records/sec, "
+         << (secs > 0 ? reader.bytes() / secs / (1 << 20) : 0.0) << " MiB/s)" << endl;
+    cout << "Imported " << commits_.size() - first << " commits" << '\n';
+    if(wal_ && commits_.size() > first) checkpoint();
+    if(!error.empty()) throw runtime_error(error);
+}
+
+void GitInt::import_commit(std::string_view message, FileVec& files) {
+    if(files.empty()) return;
+    std::stable_sort(files.begin(), files.end(),
+        [](const FileEntry& a, const FileEntry& b) { return a.name_ < b.name_; });
+    // The last record of a file wins; keep only real changes, as deltas
+    size_t out = 0;
+    for(size_t i = 0; i < files.size(); i++) {
+        if(i + 1 < files.size() && files[i + 1].name_ == files[i].name_) continue;
+        const int* old = base_files().find(files[i].name_);
+        if(!old) files[out++] = files[i];
+        else if(*old != files[i].value_) files[out++] = FileEntry(files[i].name_, files[i].value_ - *old);
+    }
+    files.resize(out);
+    append_commit(message, files, -1);
+    files.clear();
+}
+
 void GitInt::log() const {
-    for(int i = current; i > 0; i = commits_[i].parent_) {
-        log_helper(i,commits_[i].msg_);
+    for(int i = current; i > 0; i = commits_.parent(i)) {
+        log_helper(i,commits_.message(i));
+    }
+}
+
+void GitInt::log(size_t count) const {
+    for(int i = current; i > 0 && count > 0; i = commits_.parent(i), count--) {
+        log_helper(i,commits_.message(i));
+    }
+}
+
+void GitInt::log(CommitIdx from, CommitIdx to) const {
+    if(from < 0 || from >= commits_.size() || to < 0 || to >= commits_.size()) {
+        throw std::invalid_argument(INVALID_COMMIT_NUMBER);
+    }
+    // Everything `to` has that `from` does not
+    std::vector<CommitIdx> only;
+    commits_.split(from, to, NULL, &only);
+    for(CommitIdx i : only) {
+        log_helper(i,commits_.message(i));
+    }
+}
+
+void GitInt::log(std::string_view filename) const {
+    NameId id = names_.find(filename);
+    if(id == NameTable::NO_NAME) throw invalid_argument(INVALID_COMMAND);
+    index_history();
+    if(id >= history_.size()) return;
+    // Newest first: the touches at or below `current` that lie on its
+    // first-parent line
+    const std::vector<FileTouch>& touches = history_[id];
+    for(size_t i = touches.size(); i-- > 0; ) {
+        CommitIdx commit = touches[i].commit_;
+        if(commit > current) continue;
+        if(commits_.ancestor_at(current, commits_.depth(commit)) == commit) {
+            log_helper(commit, commits_.message(commit));
+        }
+    }
+}
+
+void GitInt::merge_base(CommitIdx a, CommitIdx b) const {
+    if(a < 0 || a >= commits_.size() || b < 0 || b >= commits_.size()) {
+        throw std::invalid_argument(INVALID_COMMIT_NUMBER);
+    }
+    cout << commits_.split(a, b, NULL, NULL) << '\n';
+}
+
+void GitInt::find_state(CommitIdx commit) const {
+    if(commit < 0 || commit >= commits_.size()) {
+        throw std::invalid_argument(INVALID_COMMIT_NUMBER);
+    }
+    const std::vector<CommitIdx>& same = commits_with_state(commits_.hash(commit));
+    std::vector<CommitIdx>::const_iterator it = lower_bound(same.begin(), same.end(), commit);
+    while(it != same.begin()) {
+        --it;
+        log_helper(*it, commits_.message(*it));
+    }
+}
+
+void GitInt::find_state() const {
+    const std::vector<CommitIdx>& same = commits_with_state(working_tree().hash());
+    for(std::vector<CommitIdx>::const_reverse_iterator it = same.rbegin(); it != same.rend(); ++it) {
+        log_helper(*it, commits_.message(*it));
+    }
+}
+
+const std::vector<CommitIdx>& GitInt::commits_with_state(uint64_t hash) const {
+    for(; states_upto_ < commits_.size(); states_upto_++) {
+        states_[commits_.hash(states_upto_)].push_back(states_upto_);
+    }
+    static const std::vector<CommitIdx> none;
+    std::unordered_map<uint64_t, std::vector<CommitIdx> >::const_iterator it = states_.find(hash);
+    return it == states_.end() ? none : it->second;
+}
+
+void GitInt::stat(CommitIdx commit) const {
+    if(commit < 0 || commit >= commits_.size()) {
+        throw std::invalid_argument(INVALID_COMMIT_NUMBER);
+    }
+    display_stats(commits_.stats(commit));
+}
+
+void GitInt::stat() const {
+    sync_values();
+    std::vector<int> removed, added;
+    for(const FileEntry& file : working_changes()) {
+        const int* old = base_files().find(file.name_);
+        if(old) removed.push_back(*old);
+        added.push_back(*working_file(file.name_));
+    }
+    display_stats(values_.stats(removed, added));
+}
+
+void GitInt::display_stats(const FileStats& stats) const {
+    cout << "count : " << stats.count_ << '\n';
+    cout << "sum : " << stats.sum_ << '\n';
+    if(stats.count_ > 0) {
+        cout << "min : " << stats.min_ << '\n';
+        cout << "max : " << stats.max_ << '\n';
     }
 }
 
 void GitInt::diff(CommitIdx to) const {
-    const map<string,int>& temp = checkout_helper(to);
-    const map<string,int>& diff = diff_helper(temp,untracked);
+    if(to < 0 || to >= commits_.size()) {
+        throw std::invalid_argument(INVALID_COMMIT_NUMBER);
+    }
+    const FileTree& working = working_tree();
+    if(commits_.hash(to) == working.hash()) return;
+    const FileTree& temp = checkout_helper(to);
+    const FileVec& diff = FileTree::diff(temp,working);
     display_helper(diff);
 }
 
 void GitInt::diff(CommitIdx from, CommitIdx to) const {
-    const map<string,int>& from1 = checkout_helper(from);
-    const map<string,int>& to1 = checkout_helper(to);
-    const map<string,int>& diff = diff_helper(to1, from1);
+    if(to < 0 || from >= commits_.size()) {
+        throw std::invalid_argument(INVALID_COMMIT_NUMBER);
+    }
+    if(commits_.hash(from) == commits_.hash(to)) return;
+    const FileTree& from1 = checkout_helper(from);
+    const FileTree& to1 = checkout_helper(to);
+    const FileVec& diff = FileTree::diff(to1, from1);
     display_helper(diff);
 }
 
+const FileVec& GitInt::working_changes() const {
+    if(!changes_stale_) return changes_;
+    changes_.clear();
+    const FileTree& base = base_files();
+    for(const std::pair<const NameId, int>& file : overlay_) {
+        const int* old = base.find(file.first);
+        if(!old) changes_.push_back(FileEntry(file.first, file.second));
+        else if(file.second != *old) changes_.push_back(FileEntry(file.first, file.second - *old));
+    }
+    changes_stale_ = false;
+    return changes_;
+}
+
 bool GitInt::valid_commit(CommitIdx commit) const {
-    return commit > 0 && commit <= (int)commits_.size();
+    return commit > 0 && commit < commits_.size();
 }
 
-std::map<std::string, int> GitInt::buildState(CommitIdx from, CommitIdx to) const {
-    return std::map<std::string, int>();
+FileVec GitInt::buildState(CommitIdx from, CommitIdx to) const {
+    return FileVec();
 }
 
-GitInt::GitInt() {
-    commits_.emplace_back("init", currentFiles, -1);
+GitInt::GitInt() :
+    files_pending_(false),
+    worktree_stale_(false),
+    changes_stale_(false),
+    history_upto_(0),
+    states_upto_(0),
+    keyframe_bytes_(0),
+    keyframe_interval_(DEFAULT_KEYFRAME_INTERVAL),
+    keyframe_budget_(DEFAULT_KEYFRAME_BUDGET),
+    compose_threads_(1),
+    max_depth_(0),
+#ifdef GITINT_STATS
+    stats_(std::vector<const char*>(COMMAND_NAMES, COMMAND_NAMES + CMD_COUNT)),
+#endif
+    generation_(0)
+{
     current = 0;
 }
 
-std::map<std::string, int> GitInt::checkout_helper(CommitIdx commitIdx) const {
-    vector<map<string,int> > parents;
+GitInt::~GitInt() {
+#ifdef GITINT_STATS
+    // Runs shorter than the interval get a line too
+    if(stats_.dumping()) stats_.dump(gauges());
+#endif
+}
+
+void GitInt::stats() const {
+#ifdef GITINT_STATS
+    stats_.print(cout, gauges());
+#else
+    throw runtime_error(STATS_DISABLED);
+#endif
+}
+
+void GitInt::set_stats_dump(const std::string& path, uint64_t interval_ms) {
+#ifdef GITINT_STATS
+    stats_.open_dump(path, interval_ms);
+#else
+    (void)path;
+    (void)interval_ms;
+    throw runtime_error(STATS_DISABLED);
+#endif
+}
+
+#ifdef GITINT_STATS
+std::vector<Instrumentation::Gauge> GitInt::gauges() const {
+    std::vector<Instrumentation::Gauge> gauges;
+    gauges.push_back(Instrumentation::Gauge("commits", commits_.size()));
+    gauges.push_back(Instrumentation::Gauge("commit_bytes", commits_.bytes()));
+    gauges.push_back(Instrumentation::Gauge("names", names_.size()));
+    gauges.push_back(Instrumentation::Gauge("keyframes", keyframes_.size()));
+    gauges.push_back(Instrumentation::Gauge("keyframe_bytes", keyframe_bytes_));
+    gauges.push_back(Instrumentation::Gauge("history_files", history_.size()));
+    gauges.push_back(Instrumentation::Gauge("state_hashes", states_.size()));
+    gauges.push_back(Instrumentation::Gauge("tags", tags_.size()));
+    gauges.push_back(Instrumentation::Gauge("branches", branches_.size()));
+    gauges.push_back(Instrumentation::Gauge("overlay", overlay_.size()));
+    gauges.push_back(Instrumentation::Gauge("stages", stages.size()));
+    return gauges;
+}
+#endif
+
+void GitInt::set_keyframe_interval(size_t interval) {
+    keyframe_interval_ = interval;
+}
+
+void GitInt::set_compose_threads(size_t threads) {
+    compose_threads_ = max((size_t)1, threads);
+}
+
+void GitInt::set_keyframe_budget(size_t bytes) {
+    keyframe_budget_ = bytes;
+    // Shrink right away so a lowered budget takes effect immediately
+    evict_keyframes(0);
+}
+
+size_t GitInt::keyframe_interval() const {
+    if(keyframe_interval_ > 0) return keyframe_interval_;
+    // sqrt(depth) keeps both the number of keyframes and the replay
+    // length per checkout at O(sqrt(depth))
+    return max((size_t)1, (size_t)sqrt((double)max_depth_));
+}
+
+void GitInt::evict_keyframes(size_t incoming) const {
+    // Least recently used keyframes go first
+    while(keyframe_bytes_ + incoming > keyframe_budget_ && !keyframe_lru_.empty()) {
+        std::map<CommitIdx, Keyframe>::iterator victim = keyframes_.find(keyframe_lru_.back());
+        std::unordered_map<uint64_t, CommitIdx>::iterator state =
+            keyframe_states_.find(victim->second.files_.hash());
+        if(state != keyframe_states_.end() && state->second == victim->first) {
+            keyframe_states_.erase(state);
+        }
+        keyframe_bytes_ -= victim->second.bytes_;
+        keyframe_lru_.pop_back();
+        keyframes_.erase(victim);
+    }
+}
+
+bool GitInt::cache_keyframe(CommitIdx commitIdx, FileTree& files, size_t bytes) const {
+    if(commitIdx <= 0 || commits_.depth(commitIdx) % keyframe_interval() != 0) return false;
+    if(keyframes_.find(commitIdx) != keyframes_.end()) return true;
+
+    // Reverted or re-merged states share the tree already kept
+    const FileTree* same = NULL;
+    std::unordered_map<uint64_t, CommitIdx>::const_iterator state = keyframe_states_.find(files.hash());
+    if(state != keyframe_states_.end()) {
+        // A hash match alone could be a collision: compare the contents
+        const FileTree& kept = keyframes_.find(state->second)->second.files_;
+        if(kept == files) {
+            same = &kept;
+            bytes = 0;
+        }
+    }
+    bytes += sizeof(Keyframe);
+    if(bytes > keyframe_budget_) return false;
+
+    // Carry on from the kept copy, so the nodes built for this one can go
+    if(same) files = *same;
+    evict_keyframes(bytes);
+    keyframe_lru_.push_front(commitIdx);
+    Keyframe& kf = keyframes_[commitIdx];
+    kf.files_ = files;
+    kf.bytes_ = bytes;
+    kf.lru_ = keyframe_lru_.begin();
+    keyframe_bytes_ += bytes;
+    keyframe_states_.emplace(files.hash(), commitIdx);
+    return true;
+}
+
+void GitInt::index_history() const {
+    // Each commit's diffs are relative to its first parent, so a file's
+    // new content is its content there plus the delta
+    for(; history_upto_ < commits_.size(); history_upto_++) {
+        CommitIdx commit = history_upto_;
+        for(const FileEntry& file : commits_.diffs(commit)) {
+            int value = 0;
+            value_at(file.name_, commits_.parent(commit), value);
+            if(file.name_ >= history_.size()) history_.resize(file.name_ + 1);
+            FileTouch touch = { commit, value + file.value_ };
+            history_[file.name_].push_back(touch);
+        }
+    }
+}
+
+bool GitInt::value_at(NameId id, CommitIdx commit, int& value) const {
+    if(commit < 0) return false;    // parent of "init"
+    if(id >= history_.size()) return false;
+    const std::vector<FileTouch>& touches = history_[id];
+    size_t i = upper_bound(touches.begin(), touches.end(), commit,
+        [](CommitIdx c, const FileTouch& touch) { return c < touch.commit_; }) - touches.begin();
+    // The nearest touch on the first-parent line is the newest one that
+    // is an ancestor; in a linear history that is the first one tried
+    for(size_t tried = 0; i > 0 && tried < HISTORY_SCAN_LIMIT; tried++) {
+        const FileTouch& touch = touches[--i];
+        if(commits_.ancestor_at(commit, commits_.depth(touch.commit_)) == touch.commit_) {
+            value = touch.value_;
+            return true;
+        }
+    }
+    if(i == 0) return false;
+    const int* found = checkout_helper(commit).find(id);
+    if(found) value = *found;
+    return found != NULL;
+}
+
+FileTree GitInt::checkout_helper(CommitIdx commitIdx) const {
+    // Walk back only as far as the nearest keyframe, published state or
+    // pack snapshot ("init" is empty)
+    vector<CommitIdx> parents;
+    FileTree files;
+    size_t bytes = 0;
     while(commitIdx > 0) {
-        parents.emplace_back(commits_[commitIdx].diffs_);
-        commitIdx = commits_[commitIdx].parent_;
-    }
-    vector<map<string,int> >::iterator it = parents.end()-1;
-    map<string,int> files = *it;
-    it--;
-    for(;it >= parents.begin(); it--) {
-        for(pair<string,int> pair: *it) {
-            if(files.find(pair.first) == files.end()) {
-                files[pair.first] = pair.second;
-            } else {
-                files[pair.first] += pair.second;
-            }
+        std::map<CommitIdx, Keyframe>::iterator kf = keyframes_.find(commitIdx);
+        if(kf != keyframes_.end()) {
+            keyframe_lru_.splice(keyframe_lru_.begin(), keyframe_lru_, kf->second.lru_);
+            files = kf->second.files_;
+            break;
+        }
+        const FileTree* published = commits_.state(commitIdx);
+        if(published) {
+            files = *published;
+            break;
         }
+        DiffView snapshot = commits_.snapshot(commitIdx);
+        if(!snapshot.empty()) {
+            bytes = files.apply(snapshot);
+            if(cache_keyframe(commitIdx, files, bytes)) bytes = 0;
+            break;
+        }
+        parents.push_back(commitIdx);
+        commitIdx = commits_.parent(commitIdx);
+    }
+#ifdef GITINT_STATS
+    stats_.chain().record(parents.size());
+#endif
+    for(vector<CommitIdx>::reverse_iterator it = parents.rbegin(); it != parents.rend(); ++it) {
+        bytes += files.apply(commits_.diffs(*it));
+        // Keyframes evicted earlier get rebuilt on the way down
+        if(cache_keyframe(*it, files, bytes)) bytes = 0;
     }
     return files;
 }
 
-std::map<std::string, int> GitInt::diff_helper(std::map<std::string, int> files1, std::map<std::string, int> files2) const {
-    std::map<string,int> diffs;
-    for(pair<string,int> pair : files2) {
-        if(files1.find(pair.first) != files1.end()) {
-            if(files2[pair.first] - files1[pair.first]) {
-                diffs[pair.first] = files2[pair.first] - files1[pair.first];
-            }
-        } else {
-            diffs[pair.first] = files2[pair.first];
+void GitInt::save(const std::string& path) const {
+    PackWriter writer;
+    for(NameId id = 0; id < names_.size(); id++) {
+        writer.add_name(names_.name(id));
+    }
+    // Store a full snapshot once replaying a commit's diff chain would
+    // read more entries than the snapshot itself, and always for the
+    // checked-out commit, so open() never replays much history
+    vector<size_t> chain(commits_.size(), 0);
+    for(CommitIdx i = 0; i < commits_.size(); i++) {
+        DiffView diffs = commits_.diffs(i);
+        writer.add_commit(commits_.message(i), diffs, commits_.parent(i), commits_.depth(i),
+                          commits_.jump(i), commits_.parent2(i), commits_.merges(i),
+                          commits_.hash(i), commits_.stats(i));
+        if(i == 0) continue;
+        chain[i] = chain[commits_.parent(i)] + diffs.size();
+        // The stored file count decides, so only snapshotted states are built
+        if(i == current || !commits_.snapshot(i).empty() || chain[i] > commits_.stats(i).count_) {
+            writer.add_snapshot(checkout_helper(i).to_vec());
+            chain[i] = 0;
+        }
+    }
+    for(const string& tag : tags_) {
+        writer.add_tag(tag, tags_map.at(tag));
+    }
+    for(const std::pair<const std::string, CommitIdx>& branch : branches_) {
+        writer.add_branch(branch.first, branch.second);
+    }
+    if(!branch_.empty()) writer.set_head_branch(branch_);
+    writer.write(path, current, max_depth_, generation_);
+}
+
+void GitInt::open(const std::string& path) {
+    // The log only makes sense on top of its own checkpoint
+    if(wal_) throw runtime_error(LOG_ATTACHED);
+    std::shared_ptr<PackFile> pack = std::make_shared<PackFile>();
+    pack->open(path);
+
+    // Tags and branches are the only parts read up front; do it before
+    // touching any state so a bad pack leaves the repository as it was
+    std::map<std::string, int, std::less<> > tags_map2;
+    std::vector<std::string> tags2;
+    const PackHeader& header = pack->header();
+    for(uint64_t i = 0; i < header.tag_count_; i++) {
+        const PackTag& tag = pack->tags()[i];
+        if(tag.commit_ < 0 || (uint64_t)tag.commit_ >= header.commit_count_) {
+            throw runtime_error("Corrupt repository file");
         }
+        string name(pack->string(tag.name_));
+        tags_map2[name] = tag.commit_;
+        tags2.push_back(name);
+    }
+    std::map<std::string, CommitIdx, std::less<> > branches2;
+    for(uint64_t i = 0; i < header.branch_count_; i++) {
+        const PackTag& branch = pack->branches()[i];
+        if(branch.commit_ < 0 || (uint64_t)branch.commit_ >= header.commit_count_) {
+            throw runtime_error("Corrupt repository file");
+        }
+        branches2.emplace(pack->string(branch.name_), branch.commit_);
+    }
+    string head_branch(pack->string(header.head_branch_));
+    if(!head_branch.empty() && branches2.find(head_branch) == branches2.end()) {
+        throw runtime_error("Corrupt repository file");
+    }
+
+    commits_.attach(pack);
+    names_.attach(pack);
+    tags_map.swap(tags_map2);
+    tags_.swap(tags2);
+    branches_.swap(branches2);
+    branch_.swap(head_branch);
+    stages.clear();
+    history_.clear();
+    history_upto_ = 0;
+    states_.clear();
+    states_upto_ = 0;
+    keyframes_.clear();
+    keyframe_lru_.clear();
+    keyframe_states_.clear();
+    keyframe_bytes_ = 0;
+    max_depth_ = header.max_depth_;
+    generation_ = header.generation_;
+
+    current = header.head_;
+    files_pending_ = true;
+    reset_overlay();
+    values_.clear();
+    values_files_ = FileTree();
+}
+
+void GitInt::attach_log(const std::string& path, const WalOptions& options) {
+    if(wal_) throw runtime_error(LOG_ATTACHED);
+    // No pack yet means no checkpoint yet: the log applies to an empty
+    // repository (generation 0)
+    if(access(path.c_str(), F_OK) == 0) open(path);
+    string log_path = path + ".wal";
+    WriteAheadLog::replay(log_path, generation_,
+        [this](const WriteAheadLog::Record& record) { replay_record(record); });
+    wal_.reset(new WriteAheadLog(log_path, generation_, options));
+    wal_options_ = options;
+    repo_path_ = path;
+}
+
+void GitInt::replay_record(const WriteAheadLog::Record& record) {
+    // Only changes that succeeded were logged, so they apply cleanly
+    switch(record.type_) {
+    case WriteAheadLog::CREATE:
+        create(record.text_, (int)record.value_);
+        break;
+    case WriteAheadLog::EDIT:
+        edit(record.text_, (int)record.value_);
+        break;
+    case WriteAheadLog::ADD:
+        // Not add(): a staged file may have vanished since (checkout),
+        // and the stage still counts towards the next commit
+        stages.push_back(names_.intern(record.text_));
+        break;
+    case WriteAheadLog::COMMIT:
+        commit(record.text_);
+        break;
+    case WriteAheadLog::TAG:
+        create_tag(record.text_, (CommitIdx)record.value_);
+        break;
+    case WriteAheadLog::CHECKOUT:
+        checkout((CommitIdx)record.value_);
+        break;
+    case WriteAheadLog::BRANCH:
+        create_branch(record.text_, (CommitIdx)record.value_);
+        break;
+    case WriteAheadLog::SWITCH:
+        switch_branch(record.text_);
+        break;
+    case WriteAheadLog::MERGE:
+        merge_helper(record.text_, false);
+        break;
+    case WriteAheadLog::GC:
+        gc_helper((int)record.value_, false);
+        break;
+    case WriteAheadLog::CHERRY_PICK:
+        if(record.text_.empty()) cherry_pick((CommitIdx)record.value_);
+        else cherry_pick(stoi(string(record.text_)), (CommitIdx)record.value_);
+        break;
+    case WriteAheadLog::REBASE: {
+        // Three words, of which `to` may be empty
+        size_t first = record.text_.find(' ');
+        size_t second = first == std::string_view::npos ? first : record.text_.find(' ', first + 1);
+        if(second == std::string_view::npos) throw runtime_error(LOG_CORRUPT);
+        rebase(record.text_.substr(0, first), record.text_.substr(first + 1, second - first - 1),
+               record.text_.substr(second + 1));
+        break;
+    }
+    default:
+        throw runtime_error(LOG_CORRUPT);
+    }
+}
+
+void GitInt::log_record(WriteAheadLog::RecordType type, std::string_view text, int64_t value) {
+    if(!wal_) return;
+    wal_->append(type, text, value);
+    if(wal_->bytes() > wal_options_.checkpoint_bytes_) checkpoint();
+}
+
+void GitInt::checkpoint() {
+    if(!wal_) throw runtime_error(NO_LOG_ATTACHED);
+
+    // The pack holds commits and tags; the new log starts out with the
+    // uncommitted changes so they survive the truncation
+    string records;
+    for(const FileEntry& file : working_changes()) {
+        WriteAheadLog::RecordType type =
+            base_files().find(file.name_) ? WriteAheadLog::EDIT : WriteAheadLog::CREATE;
+        WriteAheadLog::encode(records, type, names_.name(file.name_), *working_file(file.name_));
+    }
+    for(NameId id : stages) {
+        WriteAheadLog::encode(records, WriteAheadLog::ADD, names_.name(id));
+    }
+
+    // New log first, then the pack that refers to it (the commit point),
+    // then switch logs; recovery copes with a crash between any two steps
+    wal_->prepare_reset(generation_ + 1, records);
+    try {
+        generation_++;
+        save(repo_path_);
+    } catch(...) {
+        generation_--;
+        wal_->abort_reset();
+        throw;
     }
-    return diffs;
+    wal_->commit_reset();
 }
 
+Snapshot GitInt::snapshot() const {
+    // Commits first: every name they use was interned before them. Should
+    // open() replace both tables in between, the two would not match.
+    CommitTable commits = commits_.freeze();
+    NameTable names = names_.freeze();
+    while(commits.pack() != names.pack()) {
+        commits = commits_.freeze();
+        names = names_.freeze();
+    }
+    return Snapshot(commits, names);
+}
+
+void GitInt::sync_log() {
+    if(wal_) wal_->flush();
+}
@@ -4,42 +4,23 @@
 #include <map>
 #include <string>
 #include <vector>
-#include <set>
 // Add headers below
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstddef>
+#include <string_view>
+#include "filestate.h"
+#include "filetree.h"
+#include "filestats.h"
+#include "committable.h"
+#include "pack.h"
+#include "wal.h"
+#include "snapshot.h"
+#include "importer.h"
+#include "instrument.h"
 
 
-/**
- * Integral type used to index Commits
- */
-typedef int CommitIdx;
-
-/**
- * Container for data pertaining to each commit
- */
-struct CommitObj {
-    std::string msg_;
-    std::map<std::string, int> diffs_;
-    CommitIdx parent_;
-
-    /**
-     * Completed constructor
-     *
-     *  @param[in] msg
-     *     Log message for this commit.
-     *  @param[in] diffs
-     *     Map containing the filename (key) and integer *difference*
-     *     of the file from the parent commit.
-     *  @param[in] parent
-     *     Index of the parent commit.
-     */
-    CommitObj(
-        const std::string& msg,
-        std::map<std::string, int> diffs,
-        CommitIdx parent) :
-        msg_(msg), diffs_(diffs), parent_(parent)
-    {}
-};
-
 /**
  * @brief Class to model 'git' for files containing integers
  */
@@ -51,6 +32,11 @@ public:
      */
     GitInt();
 
+    /**
+     * Writes a last line to the statistics dump, if there is one
+     */
+    ~GitInt();
+
     /**
      * Prints the menu of command options.
      * [COMPLETED]
@@ -66,7 +52,7 @@ public:
      * @returns 'true' if the "quit" command was entered, 'false' otherwise
      * @throws std::invalid_argument or std::runtime_error
      */
-    bool process_command(std::string cmd_line);
+    bool process_command(std::string_view cmd_line);
 
     /**
      * Creates a new file with the given value
@@ -79,7 +65,7 @@ public:
      * @throws std::invalid_argument or std::runtime_error -
      *    See homework writeup for details on error cases
      */
-    void create(const std::string& filename, int value);
+    void create(std::string_view filename, int value);
 
     /**
      * Modifies the given file to a new value
@@ -92,7 +78,7 @@ public:
      * @throws std::invalid_argument or std::runtime_error -
      *    See homework writeup for details on error cases
      */
-    void edit(const std::string& filename, int value);
+    void edit(std::string_view filename, int value);
 
     /**
      * Displays the current contents of the given file
@@ -103,7 +89,26 @@ public:
      * @throws std::invalid_argument -
      *    See homework writeup for details on error cases
      */
-    void display(const std::string& filename) const;
+    void display(std::string_view filename) const;
+
+    /**
+     * Displays the content a file had at the given commit, without
+     * checking it out. Answered from the per-file history index: the
+     * nearest commit on the commit's first-parent line that touched the
+     * file holds its value, found by binary search plus an O(log depth)
+     * ancestor test; if other branches touched the file many times the
+     * state is rebuilt from the nearest keyframe instead. The command
+     * is "display file@N"; a working file whose name contains '@' is
+     * displayed as itself instead.
+     *
+     * @param[in] filename
+     *    Name of the file to display
+     * @param[in] commit
+     *    Commit whose version to show
+     * @throws std::invalid_argument if the commit does not exist or the
+     *    file did not exist at that commit
+     */
+    void display(std::string_view filename, CommitIdx commit) const;
 
     /**
      * Displays the current content of all files
@@ -132,7 +137,7 @@ public:
      * @throws std::invalid_argument or std::runtime_error -
      *    See homework writeup for details on error cases
      */
-    void add(std::string filename);
+    void add(std::string_view filename);
 
 
     /**
@@ -144,7 +149,7 @@ public:
      * @throws std::runtime_error -
      *    See homework writeup for details on error cases
      */
-    void commit(std::string message);
+    void commit(std::string_view message);
 
     /**
      * Associates a new tag name to the currently checked-out commit
@@ -157,7 +162,7 @@ public:
      * @throws std::invalid_argument or std::runtime_error -
      *    See homework writeup for details on error cases
      */
-    void create_tag(const std::string& tagname, CommitIdx commit);
+    void create_tag(std::string_view tagname, CommitIdx commit);
 
     /**
      * Displays all tag names in the order they were created from most
@@ -171,6 +176,10 @@ public:
      * Updates the files and content to match the state of the given commit
      * [TO BE WRITTEN]
      *
+     * O(1): the working overlay is dropped and the commit's files are
+     * only built when a later command reads them, so switching back and
+     * forth between commits costs nothing until the files are used.
+     *
      * @param[in] commit
      *    Index of the commit to checkout
      * @throws std::invalid_argument or std::runtime_error -
@@ -187,7 +196,138 @@ public:
      * @throws std::invalid_argument or std::runtime_error -
      *    See homework writeup for details on error cases
      */
-    bool checkout(std::string tag);
+    bool checkout(std::string_view tag);
+
+    /**
+     * Creates a branch: a name for a line of history that follows every
+     * commit made while it is checked out (see switch_branch)
+     *
+     * @param[in] name
+     *    Name of the new branch
+     * @param[in] commit
+     *    Commit the branch starts at
+     * @throws std::invalid_argument if the branch already exists
+     */
+    void create_branch(std::string_view name, CommitIdx commit);
+
+    /**
+     * Displays all branch names in order, marking the checked-out one
+     */
+    void branches() const;
+
+    /**
+     * Checks out the head commit of a branch; later commits advance it.
+     * Checking out a commit or tag leaves the branch.
+     *
+     * @param[in] name
+     *    Branch to switch to
+     * @throws std::invalid_argument if there is no such branch
+     */
+    bool switch_branch(std::string_view name);
+
+    /**
+     * Merges a branch (or commit number) into the checked-out commit.
+     * Every change the other side made since the histories split is
+     * added to this side's files, so deltas made on both sides to the
+     * same file add up; such files are reported as conflicts. Creates a
+     * merge commit with both parents, or just moves forward if this side
+     * has nothing of its own.
+     *
+     * Only the diffs of commits since the split are read, so merging a
+     * short branch off a deep trunk costs O(changes on the branch).
+     *
+     * @param[in] name
+     *    Branch name or commit number to merge in
+     * @throws std::invalid_argument if it names no branch or commit
+     * @throws std::runtime_error if there are uncommitted changes
+     */
+    void merge(std::string_view name);
+
+    /**
+     * Re-applies the changes of one commit on top of the checked-out
+     * commit, as a new commit with the same message. Diffs are additive,
+     * so the stored diff is added to the current files as it is, in
+     * O(its changes * log files), without building the commit's state.
+     *
+     * @param[in] commit
+     *    Commit to pick
+     * @throws std::invalid_argument if the commit does not exist
+     * @throws std::runtime_error if there are uncommitted changes
+     */
+    void cherry_pick(CommitIdx commit);
+
+    /**
+     * Like cherry_pick(CommitIdx), for the commits that `to` has and
+     * `from` does not (those of log from..to), composed into a single
+     * commit: their diffs are summed file by file in O(changes in the
+     * range * log), split among threads for long ranges (see
+     * set_compose_threads). Merge commits add nothing of their own.
+     *
+     * @throws std::invalid_argument if either commit does not exist
+     * @throws std::runtime_error if there are uncommitted changes
+     */
+    void cherry_pick(CommitIdx from, CommitIdx to);
+
+    /**
+     * Replays the commits that `to` has and `from` does not, oldest
+     * first, on top of `onto`: one new commit per original, re-applied
+     * from its stored diff, so no state is rebuilt and the cost is
+     * O(changes in the range * log files). Merge commits are dropped,
+     * which makes the replayed history linear. The last new commit ends
+     * up checked out; if `to` is a branch, that branch moves to it and
+     * stays checked out.
+     *
+     * @param[in] from, to, onto
+     *    Branch names or commit numbers; an empty one stands for the
+     *    checked-out commit (for `to`, the checked-out branch if any)
+     * @throws std::invalid_argument if any of them names no branch or commit
+     * @throws std::runtime_error if there are uncommitted changes
+     */
+    void rebase(std::string_view from, std::string_view to, std::string_view onto);
+
+    /**
+     * Garbage-collects history: keeps only the commits reachable (along
+     * both parents) from the checked-out commit, tags and branch heads,
+     * and renumbers them in their original order, updating tags and
+     * branches to match. Reports the commits dropped and the memory
+     * reclaimed: the bytes of messages and packed diffs before and after
+     * (CommitTable::encoded_bytes), which depend only on the history, not
+     * on what is cached or how the commits are stored.
+     *
+     * With a squash age, runs of commits older than that (more than
+     * `squash_age` commits before the newest) are folded into the commit
+     * that ends the run, whose diff becomes the run's combined change.
+     * A commit is folded only if nothing else needs it: it is not tagged,
+     * a branch head, checked out, a merge or merged in, and its single
+     * child (also old, not a merge) follows it. This shortens the chains
+     * that checkouts replay.
+     *
+     * @param[in] squash_age
+     *    Commits to leave unsquashed at the end of history; -1 to only
+     *    drop unreachable commits
+     */
+    void gc(int squash_age);
+
+    /**
+     * Bulk-loads history from a file of "commit,file,value" lines (see
+     * ImportReader). Consecutive records with the same commit key make
+     * one commit, with the key as its message, on top of the checked-out
+     * commit; each record sets a file's content and files not named keep
+     * theirs. Diffs are built straight from the records, with no staging
+     * or command parsing, while the next block of the file is parsed on
+     * another thread. Reports progress and throughput on stderr and the
+     * commits made on stdout.
+     *
+     * With a log attached, the import is made durable by a checkpoint at
+     * the end rather than logged record by record.
+     *
+     * @param[in] path
+     *    File to import
+     * @throws std::runtime_error if there are uncommitted changes, the
+     *    file cannot be read, or at a malformed line (commits completed
+     *    before it are kept)
+     */
+    void import(const std::string& path);
 
     /**
      * Displays the commit numbers and log message in order from the current
@@ -197,9 +337,102 @@ public:
      */
     void log() const;
 
+    /**
+     * Like log(), but stops after `count` commits
+     *
+     * @param[in] count
+     *    Most commits to display
+     */
+    void log(size_t count) const;
+
+    /**
+     * Displays the commits that are ancestors of `to` (or `to` itself)
+     * but not of `from`, newest first, like `git log from..to`
+     *
+     * @param[in] from
+     *    Commit whose history is excluded
+     * @param[in] to
+     *    Commit whose history is listed
+     * @throws std::invalid_argument if either commit does not exist
+     */
+    void log(CommitIdx from, CommitIdx to) const;
+
+    /**
+     * Like log(), but lists only the commits that changed the given
+     * file, read from the per-file history index rather than by walking
+     * every commit
+     *
+     * @param[in] filename
+     *    File whose history to list
+     * @throws std::invalid_argument if no file of that name was ever seen
+     */
+    void log(std::string_view filename) const;
+
+    /**
+     * Displays the nearest commit that both given commits descend from.
+     * O(log depth) using the commit table's skip pointers.
+     *
+     * @throws std::invalid_argument if either commit does not exist
+     */
+    void merge_base(CommitIdx a, CommitIdx b) const;
+
+    /**
+     * Displays, in log format and newest first, the commits before
+     * `commit` whose files are exactly those of `commit`. Found through
+     * an index of commit state hashes, so the cost is the number of
+     * matches rather than the size of history.
+     *
+     * @throws std::invalid_argument if the commit does not exist
+     */
+    void find_state(CommitIdx commit) const;
+
+    /**
+     * Like find_state(CommitIdx), but lists every commit whose files are
+     * exactly the working files
+     */
+    void find_state() const;
+
+    /**
+     * Displays the count, sum, minimum and maximum of the file values at
+     * a commit. Every commit records these when it is made, so this is
+     * O(1) and builds no state.
+     *
+     * @throws std::invalid_argument if the commit does not exist
+     */
+    void stat(CommitIdx commit) const;
+
+    /**
+     * Like stat(CommitIdx), for the working files: the checked-out
+     * commit's value index adjusted by the uncommitted changes, in
+     * O(changes * log files)
+     */
+    void stat() const;
+
+    /**
+     * Displays for each command type the number run and failed, latency
+     * percentiles and allocations per command; then the lengths of the
+     * diff chains that checkouts replayed, allocations overall and the
+     * sizes of the main tables. Only in builds with GITINT_STATS (see
+     * instrument.h).
+     *
+     * @throws std::runtime_error if instrumentation is compiled out
+     */
+    void stats() const;
+
+    /**
+     * Appends the figures of stats() as a JSON line to a file every
+     * `interval_ms` milliseconds while commands run, and once more at
+     * exit
+     *
+     * @throws std::runtime_error if the file cannot be opened or
+     *    instrumentation is compiled out
+     */
+    void set_stats_dump(const std::string& path, uint64_t interval_ms);
+
     /**
      * Display the file content differences between the current state back
-     * through all parent/ancestor commits until the `to` commit
+     * through all parent/ancestor commits until the `to` commit. Prints
+     * nothing without walking either tree if their hashes are equal.
      * [TO BE WRITTEN]
      *
      * @param[in] to
@@ -211,7 +444,8 @@ public:
 
     /**
      * Display the file content differences between commit `from` back
-     * through all parent/ancestor commits until the `to` commit
+     * through all parent/ancestor commits until the `to` commit. Commits
+     * with equal state hashes print nothing, rebuilding neither state.
      * [TO BE WRITTEN]
      *
      * @param[in] from
@@ -223,13 +457,114 @@ public:
      */
     void diff(CommitIdx from, CommitIdx to) const;
 
+    /**
+     * Uncommitted changes: every file whose working content differs from
+     * the checked-out commit, with the difference (or the whole content
+     * for a new file), sorted by file. Only the working overlay (files
+     * created or edited since the last checkout) is examined, and the
+     * result is kept until the next change, so this is O(changed files)
+     * however large the working tree is.
+     */
+    const FileVec& working_changes() const;
+
     /**
      *  Returns true if the given input is a valid commit number
      *  [TO BE WRITTEN]
      * @param[in] commit
      */
     bool valid_commit(CommitIdx commit) const;
-    
+
+    /**
+     * Sets how often a fully materialized state (keyframe) is kept.
+     * A keyframe is stored for every commit whose depth is a multiple
+     * of the interval, so rebuilding any commit replays at most that
+     * many diffs.
+     *
+     * @param[in] interval
+     *    Keyframe spacing in commits; 0 picks sqrt(deepest chain)
+     */
+    void set_keyframe_interval(size_t interval);
+
+    /**
+     * Caps the estimated memory held by keyframes. Once the budget is
+     * exceeded the least recently used keyframes are evicted.
+     *
+     * @param[in] bytes
+     *    Memory budget in bytes; 0 disables the cache entirely
+     */
+    void set_keyframe_budget(size_t bytes);
+
+    /**
+     * Sets how many threads compose the diffs of long cherry-picked
+     * ranges. Each takes a slice of the range; the partial sums are then
+     * merged.
+     *
+     * @param[in] threads
+     *    Threads to use, counting the caller; 1 composes serially
+     */
+    void set_compose_threads(size_t threads);
+
+    /**
+     * Writes all commits, filenames and tags, plus the checked-out commit,
+     * to a pack file. Uncommitted changes are not saved.
+     *
+     * @param[in] path
+     *    File to write; replaced atomically
+     * @throws std::runtime_error on I/O failure
+     */
+    void save(const std::string& path) const;
+
+    /**
+     * Replaces the repository with the contents of a pack file and checks
+     * out the commit that was checked out when it was saved. The file is
+     * memory-mapped and used in place, so opening does not depend on the
+     * size of the history.
+     *
+     * @param[in] path
+     *    Pack file written by save()
+     * @throws std::runtime_error if the file is missing or malformed
+     */
+    void open(const std::string& path);
+
+    /**
+     * Makes the repository durable: `path` holds the last checkpoint (a
+     * pack) and `path`.wal logs every change made since. Loads the
+     * checkpoint if there is one and replays the log on top of it, which
+     * restores the working files and staged set as well as commits and
+     * tags. Call on a freshly constructed repository.
+     *
+     * @param[in] path
+     *    Repository file; created by the first checkpoint
+     * @param[in] options
+     *    Sync policy and checkpoint threshold for the log
+     * @throws std::runtime_error on I/O failure or a malformed pack
+     */
+    void attach_log(const std::string& path, const WalOptions& options);
+
+    /**
+     * Writes the repository to its pack and truncates the log to just
+     * the uncommitted working changes. Also done automatically once the
+     * log outgrows WalOptions::checkpoint_bytes_.
+     *
+     * @throws std::runtime_error if no log is attached or on I/O failure
+     */
+    void checkpoint();
+
+    /**
+     * Forces logged changes to disk as the sync policy allows. The shell
+     * calls this before waiting for input, so a burst of commands shares
+     * a single fsync (group commit).
+     */
+    void sync_log();
+
+    /**
+     * Returns a read-only view of the history committed so far, for
+     * serving queries from other threads. This is the one member that
+     * may be called while another thread is changing the repository; the
+     * view does not change afterwards. O(1), and never blocks the writer.
+     */
+    Snapshot snapshot() const;
+
 private:
 
     /**
@@ -242,16 +577,16 @@ private:
      *    Index of the commit to end the accrual of diffs
      * @throws may vary depending on implementation
      */
-    std::map<std::string, int> buildState(CommitIdx from, CommitIdx to = 0) const;
+    FileVec buildState(CommitIdx from, CommitIdx to = 0) const;
 
     /**
-     * Displays a map containing filenames and contents in the desired format
+     * Displays files and contents in the desired format (by filename)
      * [COMPLETED]
      *
      * @param[in] dat
-     *    Filename and values map to print
+     *    Filename ids and values to print
      */
-    void display_helper(const std::map<std::string, int>& dat) const;
+    void display_helper(DiffView dat) const;
 
     /**
      * Displays a single commit in the desired log format
@@ -262,21 +597,229 @@ private:
      * @param[in] msg
      *    Log message of the commit to be printed
      */
-    void log_helper(CommitIdx commit_num, const std::string& log_message) const;
+    void log_helper(CommitIdx commit_num, std::string_view log_message) const;
 
+    /**
+     * Appends a change to the log, if one is attached, and checkpoints
+     * once the log has grown past its threshold
+     */
+    void log_record(WriteAheadLog::RecordType type, std::string_view text, int64_t value = 0);
+
+    /**
+     * Re-applies one logged change during attach_log()
+     */
+    void replay_record(const WriteAheadLog::Record& record);
 
-    // Add data members here
-    std::vector<CommitObj> commits_;
-    std::map<std::string, int> currentFiles;
-    std::map<std::string, int> untracked;
 
-    std::set<std::string> stages;
-    std::map<std::string, int> tags_map;
+    // Add data members here
+    CommitTable commits_;
+    NameTable names_;
+    // Committed files of `current`. A checkout only sets files_pending_;
+    // base_files() builds them when first needed.
+    mutable FileTree currentFiles;
+    mutable bool files_pending_;
+    // Working files are a copy-on-write overlay on currentFiles: the
+    // content of each file created or edited since the last checkout.
+    // It may still list files edited back to their committed content.
+    std::map<NameId, int> overlay_;
+    // currentFiles with overlay_ applied, for commands that need every
+    // working file; rebuilt on first use once stale
+    mutable FileTree worktree_;
+    mutable bool worktree_stale_;
+
+    std::vector<NameId> stages;
+    mutable FileVec changes_;   // working_changes(), valid unless stale
+    mutable bool changes_stale_;
+    std::map<std::string, int, std::less<> > tags_map;   // finds by string_view
     std::vector<std::string> tags_;
     CommitIdx current;
+    std::map<std::string, CommitIdx, std::less<> > branches_;
+    std::string branch_;        // checked-out branch, empty if none
+
+    FileTree checkout_helper(CommitIdx commitIdx) const;
+
+    /**
+     * Committed files of the checked-out commit, built first if a
+     * checkout deferred them
+     */
+    const FileTree& base_files() const;
+
+    /**
+     * Working content of a file: its overlay entry, else its committed
+     * content. NULL if there is no such file.
+     */
+    const int* working_file(NameId id) const;
+
+    /**
+     * Every working file as one tree: the base with the overlay applied,
+     * O(overlay * log files) after a change and O(1) otherwise
+     */
+    const FileTree& working_tree() const;
+
+    /**
+     * Makes the working files those of the base again
+     */
+    void reset_overlay();
+
+    /**
+     * One commit that changed a file, with the content it left behind
+     */
+    struct FileTouch {
+        CommitIdx commit_;
+        int value_;
+    };
+
+    /**
+     * Brings the per-file history index up to date with the commit table
+     * (commits loaded by open() are indexed on first use)
+     */
+    void index_history() const;
+
+    /**
+     * Content of a file at a commit, from the history index (which must
+     * cover the commit)
+     *
+     * @returns false if the file did not exist there
+     */
+    bool value_at(NameId id, CommitIdx commit, int& value) const;
+
+    // Per-file history index: history_[id] lists the commits that changed
+    // file `id` in commit order; commits below history_upto_ are indexed
+    mutable std::vector<std::vector<FileTouch> > history_;
+    mutable CommitIdx history_upto_;
+
+    /**
+     * Lists the commits (oldest first) whose state hash is `hash`
+     */
+    const std::vector<CommitIdx>& commits_with_state(uint64_t hash) const;
+
+    // Commits by state hash; commits below states_upto_ are indexed
+    mutable std::unordered_map<uint64_t, std::vector<CommitIdx> > states_;
+    mutable CommitIdx states_upto_;
+
+    /**
+     * Makes the given commit current, replacing the working files
+     */
+    void move_head(CommitIdx commitIdx);
+
+    /**
+     * Brings values_ up to date with currentFiles. Checkouts leave it
+     * behind, so only the difference between the state it was last
+     * synced to and the current one is applied: O(differences * log
+     * files), since subtrees shared by the two are skipped.
+     */
+    void sync_values() const;
+
+    /** Writes the lines of a stat command */
+    void display_stats(const FileStats& stats) const;
+
+    // Values of values_files_, for the aggregates of each new commit
+    mutable ValueIndex values_;
+    mutable FileTree values_files_;
+
+    /**
+     * Adds a commit on top of the current one and makes it current,
+     * advancing the checked-out branch
+     *
+     * @param[in] parent2
+     *    Merged-in commit, -1 for an ordinary commit
+     */
+    void append_commit(std::string_view message, const FileVec& diffs, CommitIdx parent2);
+
+    /**
+     * Commits one imported commit: `files` holds its records (new
+     * contents, in input order) and is sorted and emptied here
+     */
+    void import_commit(std::string_view message, FileVec& files);
+
+    /**
+     * Commit named by a branch, or by a commit number ("" is current)
+     *
+     * @throws std::invalid_argument if there is no such commit
+     */
+    CommitIdx resolve_ref(std::string_view name) const;
+
+    /**
+     * Sum of the diffs of the given commits, per file and sorted by file.
+     * Merge commits are skipped: what they bring in is made of other
+     * commits. Files whose changes cancel out are kept, with 0.
+     */
+    FileVec compose_diffs(const std::vector<CommitIdx>& commits) const;
+
+    /**
+     * Adds `delta` to the current files as a new child of the current
+     * commit (a file it does not have yet is created with its delta)
+     */
+    void apply_commit(std::string_view message, DiffView delta);
+
+    /**
+     * Performs merge(); prints its report only if `report` is set
+     */
+    void merge_helper(std::string_view name, bool report);
+
+    /**
+     * Performs gc(); prints its report only if `report` is set
+     */
+    void gc_helper(int squash_age, bool report);
+
+    /**
+     * Materialized state of a commit kept so that checkout_helper only
+     * has to replay the diffs between it and the requested commit.
+     * Trees share unchanged nodes, so bytes_ only counts the nodes this
+     * keyframe added on top of the previous one.
+     */
+    struct Keyframe {
+        FileTree files_;
+        size_t bytes_;
+        std::list<CommitIdx>::iterator lru_;
+    };
+
+    /**
+     * Spacing currently in effect (resolves the adaptive setting)
+     */
+    size_t keyframe_interval() const;
+
+    /**
+     * Stores the state of the given commit if its depth lands on the
+     * keyframe interval, evicting old keyframes to respect the budget.
+     * `bytes` is the memory the state added over the previous keyframe.
+     * A state already held for another commit is shared, not kept twice:
+     * `files` is then replaced by that equal tree.
+     *
+     * @returns true if the commit is held as a keyframe afterwards
+     */
+    bool cache_keyframe(CommitIdx commitIdx, FileTree& files, size_t bytes) const;
+
+    /**
+     * Drops least recently used keyframes until `incoming` more bytes
+     * fit in the budget.
+     */
+    void evict_keyframes(size_t incoming) const;
+
+    // Keyframe cache; mutable since const lookups fill and reorder it
+    mutable std::map<CommitIdx, Keyframe> keyframes_;
+    mutable std::list<CommitIdx> keyframe_lru_;  // front = most recent
+    mutable size_t keyframe_bytes_;
+    // Keyframe holding each state hash, for sharing identical states
+    mutable std::unordered_map<uint64_t, CommitIdx> keyframe_states_;
+    size_t keyframe_interval_;
+    size_t keyframe_budget_;
+    size_t compose_threads_;
+    int max_depth_;
+
+#ifdef GITINT_STATS
+    /** Table sizes reported with the statistics */
+    std::vector<Instrumentation::Gauge> gauges() const;
+
+    // Filled as commands run; mutable since checkout_helper records too
+    mutable Instrumentation stats_;
+#endif
 
-    std::map<std::string,int> checkout_helper(CommitIdx commitIdx) const;
-     std::map<std::string,int> diff_helper(std::map<std::string,int> files1, std::map<std::string,int> files2) const;
+    // Durability (see attach_log); wal_ is NULL when not logging
+    std::unique_ptr<WriteAheadLog> wal_;
+    WalOptions wal_options_;
+    std::string repo_path_;
+    uint64_t generation_;       // of the last checkpoint
 
 };
 
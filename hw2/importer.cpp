@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "importer.h"
+
+using namespace std;
+
+/*********************** Messages to use for errors ***************************/
+const std::string IMPORT_OPEN_FAILED = "Cannot open import file";
+const std::string IMPORT_READ_FAILED = "Cannot read import file";
+const std::string IMPORT_INVALID_LINE = "Invalid import record at line ";
+
+ImportReader::ImportReader() :
+    fd_(-1), line_(0), bytes_(0), done_(false), stop_(false)
+{
+}
+
+ImportReader::~ImportReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    room_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    if (fd_ >= 0) ::close(fd_);
+}
+
+void ImportReader::open(const std::string& path)
+{
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) throw runtime_error(IMPORT_OPEN_FAILED);
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    thread_ = std::thread(&ImportReader::run, this);
+}
+
+bool ImportReader::next(ImportBatch& batch)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this] { return !queue_.empty() || done_; });
+    if (!queue_.empty()) {
+        batch = std::move(queue_.front());
+        queue_.pop_front();
+        room_.notify_one();
+        return true;
+    }
+    if (error_) std::rethrow_exception(error_);
+    return false;
+}
+
+uint64_t ImportReader::bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+void ImportReader::run()
+{
+    // Anything thrown here (a bad line, a failed read, bad_alloc) goes to
+    // the consumer; escaping the thread would terminate the program
+    std::exception_ptr error;
+    try {
+        read_all();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    finish(error);
+}
+
+void ImportReader::read_all()
+{
+    std::vector<char> carry;    // partial last line of the previous block
+    bool eof = false;
+    while (!eof) {
+        ImportBatch batch;
+        batch.text_.swap(carry);
+        size_t used = batch.text_.size();
+        batch.text_.resize(used + BLOCK);
+        ssize_t n;
+        do {
+            n = ::read(fd_, &batch.text_[used], BLOCK);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) throw runtime_error(IMPORT_READ_FAILED);
+        batch.text_.resize(used + n);
+        eof = n == 0;
+        if (!eof) {
+            // Hold back the partial last line for the next block
+            std::vector<char>::iterator end =
+                std::find(batch.text_.rbegin(), batch.text_.rend(), '\n').base();
+            carry.assign(end, batch.text_.end());
+            batch.text_.erase(end, batch.text_.end());
+            if (batch.text_.empty()) continue;
+        }
+        std::string error;
+        bool ok = parse(batch, error);
+        if (!batch.records_.empty() && !push(batch)) return;
+        if (!ok) throw runtime_error(error);
+    }
+}
+
+bool ImportReader::parse(ImportBatch& batch, std::string& error)
+{
+    const char* p = batch.text_.data();
+    const char* end = p + batch.text_.size();
+    batch.records_.reserve(batch.text_.size() / 16);
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        std::string_view line(p, eol - p);
+        p = eol + 1;
+        line_++;
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        size_t c1 = line.find(',');
+        size_t c2 = c1 == std::string_view::npos ? c1 : line.find(',', c1 + 1);
+        bool ok = c2 != std::string_view::npos && c1 > 0 && c2 > c1 + 1;
+        ImportRecord record;
+        if (ok) {
+            record.commit_ = line.substr(0, c1);
+            record.file_ = line.substr(c1 + 1, c2 - c1 - 1);
+            // Filenames are single words, as in commands
+            ok = record.file_.find_first_of(" \t") == std::string_view::npos;
+            const char* first = line.data() + c2 + 1;
+            const char* last = line.data() + line.size();
+            std::from_chars_result res = std::from_chars(first, last, record.value_);
+            if (res.ec != std::errc() || res.ptr != last) {
+                // A first line without a value is a header
+                if (line_ == 1) continue;
+                ok = false;
+            }
+        }
+        if (!ok) {
+            error = IMPORT_INVALID_LINE + std::to_string(line_);
+            return false;
+        }
+        batch.records_.push_back(record);
+    }
+    return true;
+}
+
+bool ImportReader::push(ImportBatch& batch)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    room_.wait(lock, [this] { return queue_.size() < QUEUE_BATCHES || stop_; });
+    if (stop_) return false;
+    bytes_ += batch.text_.size();
+    queue_.push_back(std::move(batch));
+    ready_.notify_one();
+    return true;
+}
+
+void ImportReader::finish(std::exception_ptr error)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = error;
+        done_ = true;
+    }
+    ready_.notify_all();
+}
@@ -0,0 +1,116 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <exception>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * One "commit,file,value" line of an import file
+ */
+struct ImportRecord {
+    std::string_view commit_;   // key shared by the records of one commit
+    std::string_view file_;
+    int value_;                 // content of the file at that commit
+};
+
+/**
+ * A block of the input and the records parsed from it. The records view
+ * into text_, whose buffer does not move when the batch is moved.
+ */
+struct ImportBatch {
+    std::vector<char> text_;
+    std::vector<ImportRecord> records_;
+};
+
+/**
+ * Parses an import file (CSV lines "commit,file,value") on a thread of
+ * its own and hands the records over in batches, so parsing overlaps
+ * with whatever the caller does with the previous batch. The input is
+ * read in large blocks; at most a few parsed blocks are queued, so
+ * memory stays bounded however large the file is.
+ *
+ * Blank lines are skipped, as is a first line whose value field is not
+ * a number (a header). Parsing stops at the first malformed line; the
+ * batches before it are still delivered.
+ */
+class ImportReader {
+public:
+    ImportReader();
+
+    /** Stops the parser thread, abandoning any unread batches */
+    ~ImportReader();
+
+    /**
+     * Opens `path` and starts parsing it
+     *
+     * @throws std::runtime_error if the file cannot be opened
+     */
+    void open(const std::string& path);
+
+    /**
+     * Waits for the next batch and moves it into `batch`
+     *
+     * @returns false once every record has been delivered
+     * @throws std::runtime_error at a malformed line or a failed read,
+     *    after the batches parsed before it, or whatever else stopped
+     *    the parser thread
+     */
+    bool next(ImportBatch& batch);
+
+    /** Input bytes parsed so far */
+    uint64_t bytes() const;
+
+private:
+    ImportReader(const ImportReader&);
+    ImportReader& operator=(const ImportReader&);
+
+    /** Parser thread: runs read_all() and hands on how it ended */
+    void run();
+
+    /**
+     * Reads, splits and parses blocks until the end of the input, or
+     * until stopped
+     *
+     * @throws std::runtime_error at a malformed line or a failed read
+     */
+    void read_all();
+
+    /**
+     * Parses the complete lines of `batch.text_` into its records
+     *
+     * @returns false at a malformed line, with the reason in `error`
+     */
+    bool parse(ImportBatch& batch, std::string& error);
+
+    /** Queues a batch, waiting for room; false if stopped meanwhile */
+    bool push(ImportBatch& batch);
+
+    /** Marks the end of the input (or the exception that ended it) */
+    void finish(std::exception_ptr error);
+
+    static const size_t BLOCK = 1u << 20;
+    static const size_t QUEUE_BATCHES = 4;
+
+    int fd_;
+    uint64_t line_;             // lines parsed so far (parser thread only)
+    std::thread thread_;
+
+    // Shared with the parser thread
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;     // a batch was queued, or done_
+    std::condition_variable room_;      // a batch was taken, or stop_
+    std::deque<ImportBatch> queue_;
+    uint64_t bytes_;
+    bool done_;
+    bool stop_;
+    std::exception_ptr error_;  // why parsing stopped early, if it did
+};
+
+#endif
@@ -0,0 +1,310 @@
+#include "instrument.h"
+
+#ifdef GITINT_STATS
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <new>
+#include <stdexcept>
+
+using namespace std;
+
+/*********************** Messages to use for errors ***************************/
+const std::string STATS_OPEN_FAILED = "Cannot open statistics file";
+
+/*********************** Allocation counting **********************************/
+namespace {
+
+// Relaxed: only totals are read, and other threads (import, composition)
+// allocate too
+std::atomic<uint64_t> alloc_count(0);
+std::atomic<uint64_t> alloc_bytes(0);
+
+// Every form of new and delete goes through these two, so the counts
+// cover them all and any new pairs with any delete
+void* counted_malloc(std::size_t size, std::size_t alignment)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) return malloc(size);
+    void* p = nullptr;
+    if (posix_memalign(&p, alignment, size) != 0) return nullptr;
+    return p;
+}
+
+void counted_free(void* p) noexcept
+{
+    free(p);
+}
+
+void* counted_new(std::size_t size, std::size_t alignment)
+{
+    void* p = counted_malloc(size, alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    return counted_new(size, 0);
+}
+
+void* operator new[](std::size_t size)
+{
+    return counted_new(size, 0);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, 0);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return counted_new(size, (std::size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return counted_new(size, (std::size_t)alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, (std::size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, (std::size_t)alignment);
+}
+
+void operator delete(void* p) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    counted_free(p);
+}
+
+uint64_t allocation_count()
+{
+    return alloc_count.load(std::memory_order_relaxed);
+}
+
+uint64_t allocation_bytes()
+{
+    return alloc_bytes.load(std::memory_order_relaxed);
+}
+
+/*********************** Histogram ********************************************/
+Histogram::Histogram() : count_(0), sum_(0), max_(0)
+{
+}
+
+unsigned Histogram::bucket(uint64_t value)
+{
+    if (value < (1u << SUB_BITS)) return (unsigned)value;
+    unsigned top = 63 - __builtin_clzll(value);
+    unsigned sub = (unsigned)(value >> (top - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+    return ((top - SUB_BITS + 1) << SUB_BITS) | sub;
+}
+
+uint64_t Histogram::bucket_max(unsigned index)
+{
+    if (index < (1u << SUB_BITS)) return index;
+    unsigned top = (index >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = index & ((1u << SUB_BITS) - 1);
+    uint64_t low = ((1ull << SUB_BITS) | sub) << (top - SUB_BITS);
+    return low + (1ull << (top - SUB_BITS)) - 1;
+}
+
+void Histogram::record(uint64_t value)
+{
+    if (counts_.empty()) counts_.resize(BUCKETS);
+    counts_[bucket(value)]++;
+    count_++;
+    sum_ += value;
+    if (value > max_) max_ = value;
+}
+
+uint64_t Histogram::percentile(double q) const
+{
+    if (count_ == 0) return 0;
+    uint64_t rank = (uint64_t)(q * count_ + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < BUCKETS; i++) {
+        seen += counts_[i];
+        // The top bucket's bound may lie past anything recorded
+        if (seen >= rank) return std::min(bucket_max(i), max_);
+    }
+    return max_;
+}
+
+/*********************** Instrumentation **************************************/
+Instrumentation::Scope::Scope(Instrumentation& stats, size_t command) :
+    stats_(stats), command_(command), exceptions_(std::uncaught_exceptions()),
+    allocs_(allocation_count()), alloc_bytes_(allocation_bytes()), start_(Clock::now())
+{
+}
+
+Instrumentation::Scope::~Scope()
+{
+    stats_.last_ = Clock::now();
+    Command& command = stats_.commands_[command_];
+    command.count_++;
+    if (std::uncaught_exceptions() > exceptions_) command.errors_++;
+    command.allocs_ += allocation_count() - allocs_;
+    command.alloc_bytes_ += allocation_bytes() - alloc_bytes_;
+    command.latency_.record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stats_.last_ - start_).count());
+}
+
+Instrumentation::Instrumentation(const std::vector<const char*>& names) :
+    names_(names), commands_(names.size()), start_(Clock::now()), last_(start_),
+    interval_(0)
+{
+}
+
+void Instrumentation::open_dump(const std::string& path, uint64_t interval_ms)
+{
+    dump_.close();
+    dump_.clear();
+    dump_.open(path, std::ios::app);
+    if (!dump_) throw runtime_error(STATS_OPEN_FAILED);
+    interval_ = std::chrono::milliseconds(interval_ms);
+    next_dump_ = Clock::now() + interval_;
+}
+
+void Instrumentation::dump(const std::vector<Gauge>& gauges)
+{
+    write_json(dump_, gauges);
+    dump_ << '\n';
+    dump_.flush();
+    next_dump_ = last_ + interval_;
+}
+
+void Instrumentation::write_json(std::ostream& out, const std::vector<Gauge>& gauges) const
+{
+    out << "{\"elapsed_ms\":"
+        << std::chrono::duration_cast<std::chrono::milliseconds>(last_ - start_).count()
+        << ",\"commands\":{";
+    bool first = true;
+    for (size_t i = 0; i < commands_.size(); i++) {
+        const Command& c = commands_[i];
+        if (c.count_ == 0) continue;
+        out << (first ? "" : ",") << '"' << names_[i] << "\":{\"count\":" << c.count_
+            << ",\"errors\":" << c.errors_
+            << ",\"mean_ns\":" << (uint64_t)c.latency_.mean()
+            << ",\"p50_ns\":" << c.latency_.percentile(0.50)
+            << ",\"p90_ns\":" << c.latency_.percentile(0.90)
+            << ",\"p99_ns\":" << c.latency_.percentile(0.99)
+            << ",\"max_ns\":" << c.latency_.max()
+            << ",\"allocs\":" << c.allocs_
+            << ",\"alloc_bytes\":" << c.alloc_bytes_ << '}';
+        first = false;
+    }
+    out << "},\"checkout_chain\":{\"count\":" << chain_.count()
+        << ",\"p50\":" << chain_.percentile(0.50)
+        << ",\"p99\":" << chain_.percentile(0.99)
+        << ",\"max\":" << chain_.max() << '}'
+        << ",\"allocs\":" << allocation_count()
+        << ",\"alloc_bytes\":" << allocation_bytes();
+    for (const Gauge& gauge : gauges) {
+        out << ",\"" << gauge.first << "\":" << gauge.second;
+    }
+    out << '}';
+}
+
+void Instrumentation::print(std::ostream& out, const std::vector<Gauge>& gauges) const
+{
+    // Latencies in microseconds
+    out << std::left << std::setw(12) << "command" << std::right
+        << std::setw(10) << "count" << std::setw(8) << "errors"
+        << std::setw(10) << "p50 us" << std::setw(10) << "p90 us"
+        << std::setw(10) << "p99 us" << std::setw(10) << "max us"
+        << std::setw(11) << "allocs/op" << '\n';
+    out << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < commands_.size(); i++) {
+        const Command& c = commands_[i];
+        if (c.count_ == 0) continue;
+        out << std::left << std::setw(12) << names_[i] << std::right
+            << std::setw(10) << c.count_ << std::setw(8) << c.errors_
+            << std::setw(10) << c.latency_.percentile(0.50) / 1e3
+            << std::setw(10) << c.latency_.percentile(0.90) / 1e3
+            << std::setw(10) << c.latency_.percentile(0.99) / 1e3
+            << std::setw(10) << c.latency_.max() / 1e3
+            << std::setw(11) << (double)c.allocs_ / c.count_ << '\n';
+    }
+    out << std::defaultfloat;
+    out << "checkout chain : " << chain_.count() << " rebuilds, p50 " << chain_.percentile(0.50)
+        << ", p99 " << chain_.percentile(0.99) << ", max " << chain_.max() << " diffs" << '\n';
+    out << "allocations : " << allocation_count() << " (" << allocation_bytes() << " bytes)" << '\n';
+    for (const Gauge& gauge : gauges) {
+        out << gauge.first << " : " << gauge.second << '\n';
+    }
+}
+
+#endif
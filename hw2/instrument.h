@@ -0,0 +1,161 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Performance instrumentation, compiled in only when GITINT_STATS is
+ * defined (the Makefile does so unless built with `make STATS=`). Without
+ * it none of this is built and GitInt keeps no counters, times nothing
+ * and leaves operator new alone.
+ */
+#ifdef GITINT_STATS
+
+/**
+ * Histogram of non-negative integers in log-linear buckets, after HDR
+ * Histogram: values below 16 are counted exactly, and each power of two
+ * above that is split into 16 buckets, so any value is known to within
+ * 1/16 (6%) whatever its magnitude. Buckets are allocated on the first
+ * record, so an unused histogram costs a few words.
+ */
+class Histogram {
+public:
+    Histogram();
+
+    void record(uint64_t value);
+
+    uint64_t count() const {
+        return count_;
+    }
+
+    uint64_t max() const {
+        return max_;
+    }
+
+    double mean() const {
+        return count_ ? (double)sum_ / count_ : 0.0;
+    }
+
+    /**
+     * Smallest bucket bound that at least a fraction `q` of the recorded
+     * values do not exceed (0 if nothing was recorded)
+     */
+    uint64_t percentile(double q) const;
+
+private:
+    static const unsigned SUB_BITS = 4;
+    static const unsigned BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+    static unsigned bucket(uint64_t value);
+    static uint64_t bucket_max(unsigned index);
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+/**
+ * Allocations made through operator new by the whole process (all
+ * threads), counted by the replacement in instrument.cpp
+ */
+uint64_t allocation_count();
+uint64_t allocation_bytes();
+
+/**
+ * Counters and histograms for every command type, plus the periodic
+ * JSON-lines dump. Single-threaded, like GitInt itself.
+ */
+class Instrumentation {
+public:
+    /** Named value sampled when reporting (table sizes and the like) */
+    typedef std::pair<const char*, uint64_t> Gauge;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Command {
+        uint64_t count_;
+        uint64_t errors_;           // ended by an exception
+        uint64_t allocs_;
+        uint64_t alloc_bytes_;
+        Histogram latency_;         // nanoseconds
+
+        Command() : count_(0), errors_(0), allocs_(0), alloc_bytes_(0) {}
+    };
+
+    /**
+     * Times one command and counts its allocations, recording them when
+     * it goes out of scope (also when the command throws)
+     */
+    class Scope {
+    public:
+        Scope(Instrumentation& stats, size_t command);
+        ~Scope();
+
+    private:
+        Instrumentation& stats_;
+        size_t command_;
+        int exceptions_;
+        uint64_t allocs_;
+        uint64_t alloc_bytes_;
+        Clock::time_point start_;
+    };
+
+    /**
+     * @param[in] names
+     *    Name of each command type, indexed by the command numbers
+     *    passed to Scope
+     */
+    explicit Instrumentation(const std::vector<const char*>& names);
+
+    /** Diffs replayed per state rebuild in GitInt::checkout_helper */
+    Histogram& chain() {
+        return chain_;
+    }
+
+    /**
+     * Appends a JSON line to `path` every `interval_ms` milliseconds of
+     * commands (checked as each command ends)
+     *
+     * @throws std::runtime_error if the file cannot be opened
+     */
+    void open_dump(const std::string& path, uint64_t interval_ms);
+
+    /** True if open_dump() was called */
+    bool dumping() const {
+        return dump_.is_open();
+    }
+
+    /** True once a dump is due */
+    bool dump_due() const {
+        return dump_.is_open() && last_ >= next_dump_;
+    }
+
+    /** Writes the next JSON line, with the given gauges */
+    void dump(const std::vector<Gauge>& gauges);
+
+    /** Writes the report of the `stats` command */
+    void print(std::ostream& out, const std::vector<Gauge>& gauges) const;
+
+private:
+    void write_json(std::ostream& out, const std::vector<Gauge>& gauges) const;
+
+    std::vector<const char*> names_;
+    std::vector<Command> commands_;
+    Histogram chain_;
+    Clock::time_point start_;
+    Clock::time_point last_;    // when the last command ended
+    std::ofstream dump_;
+    std::chrono::milliseconds interval_;
+    Clock::time_point next_dump_;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pack.h"
+
+using namespace std;
+
+/*********************** Messages to use for errors ***************************/
+const std::string PACK_OPEN_FAILED = "Cannot open repository file";
+const std::string PACK_WRITE_FAILED = "Cannot write repository file";
+const std::string PACK_CORRUPT = "Corrupt repository file";
+
+namespace {
+
+uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+/**
+ * True if `count` records of `size` bytes starting at `offset` fit
+ * within a file of `file_size` bytes
+ */
+bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size)
+{
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+void write_all(int fd, const void* data, size_t bytes)
+{
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, p, bytes);
+        if (n < 0) throw runtime_error(PACK_WRITE_FAILED);
+        p += n;
+        bytes -= n;
+    }
+}
+
+}
+
+uint64_t pack_hash(std::string_view text)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < text.size(); i++) {
+        h ^= (unsigned char)text[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+void sync_parent_dir(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    ::close(fd);
+}
+
+PackFile::PackFile() : base_(NULL), size_(0), header_(NULL)
+{
+}
+
+PackFile::~PackFile()
+{
+    if (base_) {
+        munmap(const_cast<char*>(base_), size_);
+    }
+}
+
+void PackFile::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error(PACK_OPEN_FAILED);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PackHeader)) {
+        ::close(fd);
+        throw runtime_error(PACK_CORRUPT);
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) throw runtime_error(PACK_OPEN_FAILED);
+
+    if (base_) munmap(const_cast<char*>(base_), size_);
+    base_ = static_cast<const char*>(map);
+    size_ = st.st_size;
+    header_ = reinterpret_cast<const PackHeader*>(base_);
+
+    // Only the header is inspected; sections are paged in on use
+    const PackHeader& h = *header_;
+    if (memcmp(h.magic_, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+            h.endian_ != PACK_ENDIAN ||
+            h.version_ != PACK_VERSION ||
+            h.file_size_ != size_ ||
+            h.commit_count_ == 0 ||
+            !fits(h.commit_offset_, h.commit_count_, sizeof(PackCommit), size_) ||
+            !fits(h.entry_offset_, h.entry_count_, sizeof(FileEntry), size_) ||
+            !fits(h.name_offset_, h.name_count_, sizeof(PackRange), size_) ||
+            !fits(h.hash_offset_, h.hash_slots_, sizeof(uint32_t), size_) ||
+            !fits(h.tag_offset_, h.tag_count_, sizeof(PackTag), size_) ||
+            !fits(h.branch_offset_, h.branch_count_, sizeof(PackTag), size_) ||
+            !fits(h.string_offset_, h.string_bytes_, 1, size_) ||
+            (h.hash_slots_ & (h.hash_slots_ - 1)) != 0 ||
+            h.hash_slots_ <= h.name_count_ ||
+            h.head_ < 0 || (uint64_t)h.head_ >= h.commit_count_) {
+        throw runtime_error(PACK_CORRUPT);
+    }
+}
+
+const PackCommit& PackFile::commit(uint64_t index) const
+{
+    const PackCommit& commit = section<PackCommit>(header_->commit_offset_)[index];
+    // Parent and skip pointer must lead back towards "init" so history
+    // walks always terminate
+    if (index > 0 ? (commit.parent_ < 0 || (uint64_t)commit.parent_ >= index ||
+                     commit.jump_ < 0 || commit.jump_ > commit.parent_ ||
+                     commit.parent2_ < -1 || (int64_t)commit.parent2_ >= (int64_t)index)
+                  : (commit.parent_ != -1 || commit.jump_ != 0 || commit.parent2_ != -1)) {
+        throw runtime_error(PACK_CORRUPT);
+    }
+    return commit;
+}
+
+std::string_view PackFile::string(const PackRange& range) const
+{
+    if (!fits(range.offset_, range.count_, 1, header_->string_bytes_)) {
+        throw runtime_error(PACK_CORRUPT);
+    }
+    return std::string_view(section<char>(header_->string_offset_) + range.offset_, range.count_);
+}
+
+DiffView PackFile::entry_range(const PackRange& range) const
+{
+    if (!fits(range.offset_, range.count_, 1, header_->entry_count_)) {
+        throw runtime_error(PACK_CORRUPT);
+    }
+    const FileEntry* first = entries() + range.offset_;
+    // Every name must be interned, or lookups would index past the name
+    // table; the caller reads all the entries anyway
+    for (const FileEntry* entry = first; entry != first + range.count_; ++entry) {
+        if (entry->name_ >= header_->name_count_) throw runtime_error(PACK_CORRUPT);
+    }
+    return DiffView(first, first + range.count_);
+}
+
+PackWriter::PackWriter()
+{
+    memset(&head_branch_, 0, sizeof(head_branch_));
+}
+
+PackRange PackWriter::add_string(std::string_view text)
+{
+    PackRange range = { strings_.size(), (uint32_t)text.size(), 0 };
+    strings_.append(text.data(), text.size());
+    return range;
+}
+
+void PackWriter::add_name(std::string_view name)
+{
+    names_.push_back(add_string(name));
+}
+
+void PackWriter::add_commit(std::string_view msg, DiffView diffs, int32_t parent, int32_t depth,
+                            int32_t jump, int32_t parent2, int32_t merges, uint64_t state_hash,
+                            const FileStats& stats)
+{
+    PackCommit commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.parent_ = parent;
+    commit.depth_ = depth;
+    commit.jump_ = jump;
+    commit.parent2_ = parent2;
+    commit.merges_ = merges;
+    commit.state_hash_ = state_hash;
+    commit.file_count_ = stats.count_;
+    commit.sum_ = stats.sum_;
+    commit.min_ = stats.min_;
+    commit.max_ = stats.max_;
+    commit.msg_ = add_string(msg);
+    commit.diffs_.offset_ = entries_.size();
+    commit.diffs_.count_ = diffs.size();
+    entries_.insert(entries_.end(), diffs.begin(), diffs.end());
+    commits_.push_back(commit);
+}
+
+void PackWriter::add_snapshot(const FileVec& files)
+{
+    PackRange& snapshot = commits_.back().snapshot_;
+    std::unordered_map<uint64_t, PackRange>::iterator it = snapshots_.find(commits_.back().state_hash_);
+    if (it != snapshots_.end() && it->second.count_ == files.size() &&
+        std::equal(files.begin(), files.end(), entries_.begin() + it->second.offset_,
+            [](const FileEntry& a, const FileEntry& b) {
+                return a.name_ == b.name_ && a.value_ == b.value_;
+            })) {
+        // Same state as an earlier commit (checked, not just the hash)
+        snapshot = it->second;
+        return;
+    }
+    snapshot.offset_ = entries_.size();
+    snapshot.count_ = files.size();
+    entries_.insert(entries_.end(), files.begin(), files.end());
+    snapshots_[commits_.back().state_hash_] = snapshot;
+}
+
+void PackWriter::add_tag(std::string_view name, int32_t commit)
+{
+    PackTag tag;
+    memset(&tag, 0, sizeof(tag));
+    tag.name_ = add_string(name);
+    tag.commit_ = commit;
+    tags_.push_back(tag);
+}
+
+void PackWriter::add_branch(std::string_view name, int32_t commit)
+{
+    PackTag branch;
+    memset(&branch, 0, sizeof(branch));
+    branch.name_ = add_string(name);
+    branch.commit_ = commit;
+    branches_.push_back(branch);
+}
+
+void PackWriter::set_head_branch(std::string_view name)
+{
+    head_branch_ = add_string(name);
+}
+
+void PackWriter::write(const std::string& path, int32_t head, int32_t max_depth,
+                       uint64_t generation) const
+{
+    // Name index: power-of-two table at most half full, linear probing
+    uint64_t slots = 1;
+    while (slots < 2 * names_.size()) slots <<= 1;
+    vector<uint32_t> hash(slots, NameTable::NO_NAME);
+    for (size_t id = 0; id < names_.size(); id++) {
+        std::string_view name(strings_.data() + names_[id].offset_, names_[id].count_);
+        uint64_t slot = pack_hash(name) & (slots - 1);
+        while (hash[slot] != NameTable::NO_NAME) slot = (slot + 1) & (slots - 1);
+        hash[slot] = id;
+    }
+
+    PackHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic_, PACK_MAGIC, sizeof(PACK_MAGIC));
+    h.version_ = PACK_VERSION;
+    h.endian_ = PACK_ENDIAN;
+    h.head_ = head;
+    h.max_depth_ = max_depth;
+    h.generation_ = generation;
+    h.head_branch_ = head_branch_;
+    uint64_t at = align8(sizeof(PackHeader));
+    h.commit_count_ = commits_.size();
+    h.commit_offset_ = at;
+    at = align8(at + commits_.size() * sizeof(PackCommit));
+    h.entry_count_ = entries_.size();
+    h.entry_offset_ = at;
+    at = align8(at + entries_.size() * sizeof(FileEntry));
+    h.name_count_ = names_.size();
+    h.name_offset_ = at;
+    at = align8(at + names_.size() * sizeof(PackRange));
+    h.hash_slots_ = slots;
+    h.hash_offset_ = at;
+    at = align8(at + slots * sizeof(uint32_t));
+    h.tag_count_ = tags_.size();
+    h.tag_offset_ = at;
+    at = align8(at + tags_.size() * sizeof(PackTag));
+    h.branch_count_ = branches_.size();
+    h.branch_offset_ = at;
+    at = align8(at + branches_.size() * sizeof(PackTag));
+    h.string_bytes_ = strings_.size();
+    h.string_offset_ = at;
+    h.file_size_ = at + strings_.size();
+
+    // Write next to the target and rename so a crash never leaves a
+    // half-written pack under the real name
+    string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw runtime_error(PACK_WRITE_FAILED);
+    try {
+        static const char zeros[8] = { 0 };
+        uint64_t written = 0;
+        const pair<const void*, uint64_t> sections[] = {
+            make_pair((const void*)&h, (uint64_t)sizeof(h)),
+            make_pair((const void*)commits_.data(), (uint64_t)(commits_.size() * sizeof(PackCommit))),
+            make_pair((const void*)entries_.data(), (uint64_t)(entries_.size() * sizeof(FileEntry))),
+            make_pair((const void*)names_.data(), (uint64_t)(names_.size() * sizeof(PackRange))),
+            make_pair((const void*)hash.data(), (uint64_t)(hash.size() * sizeof(uint32_t))),
+            make_pair((const void*)tags_.data(), (uint64_t)(tags_.size() * sizeof(PackTag))),
+            make_pair((const void*)branches_.data(), (uint64_t)(branches_.size() * sizeof(PackTag))),
+        };
+        for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); i++) {
+            write_all(fd, sections[i].first, sections[i].second);
+            written += sections[i].second;
+            write_all(fd, zeros, align8(written) - written);
+            written = align8(written);
+        }
+        write_all(fd, strings_.data(), strings_.size());
+        if (fsync(fd) != 0) throw runtime_error(PACK_WRITE_FAILED);
+    } catch (...) {
+        ::close(fd);
+        unlink(tmp.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw runtime_error(PACK_WRITE_FAILED);
+    }
+    sync_parent_dir(path);
+}
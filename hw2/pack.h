@@ -0,0 +1,223 @@
+#ifndef PACK_H
+#define PACK_H
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include "filestate.h"
+#include "filestats.h"
+
+/**
+ * On-disk repository ("pack") layout. Every section is a plain array of
+ * the fixed-size records below, 8-byte aligned, so a mapped pack is used
+ * in place without any decoding step:
+ *
+ *   PackHeader
+ *   PackCommit[commit_count]     commit table, indexed by CommitIdx
+ *   FileEntry[entry_count]       diff and snapshot arrays
+ *   PackRange[name_count]        interned filenames, indexed by NameId
+ *   uint32_t[hash_slots]         open-addressing index: name -> NameId
+ *   PackTag[tag_count]           tags in creation order
+ *   PackTag[branch_count]        branches (name + head commit)
+ *   char[string_bytes]           messages, filenames and tag names
+ *
+ * Integers are stored in host byte order; endian_ guards against
+ * opening a pack written on a machine of the other byte order.
+ */
+const char PACK_MAGIC[8] = { 'G', 'I', 'T', 'I', 'N', 'T', 'P', 'K' };
+const uint32_t PACK_VERSION = 6;
+const uint32_t PACK_ENDIAN = 0x01020304u;
+
+/**
+ * Range within the entry section or the string section
+ */
+struct PackRange {
+    uint64_t offset_;           // first element (index into the section)
+    uint32_t count_;
+    uint32_t reserved_;
+};
+
+struct PackHeader {
+    char magic_[8];
+    uint32_t version_;
+    uint32_t endian_;
+    uint64_t file_size_;
+    int32_t head_;              // checked-out commit when saved
+    int32_t max_depth_;
+    uint64_t generation_;       // write-ahead log generation that follows
+    PackRange head_branch_;     // checked-out branch, count_ 0 if detached
+    uint64_t commit_count_, commit_offset_;
+    uint64_t entry_count_, entry_offset_;
+    uint64_t name_count_, name_offset_;
+    uint64_t hash_slots_, hash_offset_;
+    uint64_t tag_count_, tag_offset_;
+    uint64_t branch_count_, branch_offset_;
+    uint64_t string_bytes_, string_offset_;
+};
+
+struct PackCommit {
+    int32_t parent_;
+    int32_t depth_;
+    PackRange msg_;             // into the string section
+    PackRange diffs_;           // into the entry section
+    PackRange snapshot_;        // full state, count_ 0 if not stored
+    int32_t jump_;              // skip pointer (see CommitTable)
+    int32_t parent2_;           // merged-in parent, -1 if none
+    int32_t merges_;            // merges on the first-parent chain
+    uint32_t file_count_;       // FileStats of the commit's state
+    uint64_t state_hash_;       // FileTree::hash() of the commit's state
+    int64_t sum_;
+    int32_t min_;
+    int32_t max_;
+};
+
+struct PackTag {
+    PackRange name_;
+    int32_t commit_;
+    uint32_t reserved_;
+};
+
+/**
+ * Hash used by the on-disk name index (64-bit FNV-1a)
+ */
+uint64_t pack_hash(std::string_view text);
+
+/**
+ * Makes a rename or creation of `path` durable by syncing the directory
+ * that holds it (best effort)
+ */
+void sync_parent_dir(const std::string& path);
+
+/**
+ * Read-only memory mapping of a pack file. Opening only maps the file
+ * and checks the header; pages are brought in by the OS as sections are
+ * touched.
+ */
+class PackFile {
+public:
+    PackFile();
+    ~PackFile();
+
+    /**
+     * Maps the given file and validates its header
+     *
+     * @throws std::runtime_error if the file is missing or malformed
+     */
+    void open(const std::string& path);
+
+    const PackHeader& header() const {
+        return *header_;
+    }
+
+    /**
+     * Returns the given commit record, checking that its parent comes
+     * before it so history walks always terminate
+     *
+     * @throws std::runtime_error if the record is inconsistent
+     */
+    const PackCommit& commit(uint64_t index) const;
+
+    const FileEntry* entries() const {
+        return section<FileEntry>(header_->entry_offset_);
+    }
+
+    const PackRange* names() const {
+        return section<PackRange>(header_->name_offset_);
+    }
+
+    const uint32_t* name_hash() const {
+        return section<uint32_t>(header_->hash_offset_);
+    }
+
+    const PackTag* tags() const {
+        return section<PackTag>(header_->tag_offset_);
+    }
+
+    const PackTag* branches() const {
+        return section<PackTag>(header_->branch_offset_);
+    }
+
+    /**
+     * Returns the given range of the string section
+     *
+     * @throws std::runtime_error if the range lies outside the pack
+     */
+    std::string_view string(const PackRange& range) const;
+
+    /**
+     * Returns the given entry range, checking it against the section and
+     * each entry's NameId against the name count
+     *
+     * @throws std::runtime_error if the range lies outside the pack or
+     *    names a file the pack does not have
+     */
+    DiffView entry_range(const PackRange& range) const;
+
+private:
+    PackFile(const PackFile&);
+    PackFile& operator=(const PackFile&);
+
+    template <typename T>
+    const T* section(uint64_t offset) const {
+        return reinterpret_cast<const T*>(base_ + offset);
+    }
+
+    const char* base_;
+    size_t size_;
+    const PackHeader* header_;
+};
+
+/**
+ * Collects repository contents and writes them out in pack layout
+ */
+class PackWriter {
+public:
+    PackWriter();
+
+    /** Appends a name; names must be added in NameId order */
+    void add_name(std::string_view name);
+
+    /** Appends a commit; commits must be added in CommitIdx order */
+    void add_commit(std::string_view msg, DiffView diffs, int32_t parent, int32_t depth,
+                    int32_t jump, int32_t parent2, int32_t merges, uint64_t state_hash,
+                    const FileStats& stats);
+
+    /**
+     * Stores the full state of the most recently added commit. A state
+     * already stored for an earlier commit is shared rather than written
+     * again.
+     */
+    void add_snapshot(const FileVec& files);
+
+    void add_tag(std::string_view name, int32_t commit);
+
+    void add_branch(std::string_view name, int32_t commit);
+
+    /** Records the checked-out branch (none by default) */
+    void set_head_branch(std::string_view name);
+
+    /**
+     * Writes the pack to `path` atomically (temporary file + rename)
+     *
+     * @throws std::runtime_error on I/O failure
+     */
+    void write(const std::string& path, int32_t head, int32_t max_depth,
+               uint64_t generation = 0) const;
+
+private:
+    PackRange add_string(std::string_view text);
+
+    std::vector<PackCommit> commits_;
+    std::vector<FileEntry> entries_;
+    std::vector<PackRange> names_;
+    std::vector<PackTag> tags_;
+    std::vector<PackTag> branches_;
+    // Snapshots written so far, by state hash
+    std::unordered_map<uint64_t, PackRange> snapshots_;
+    PackRange head_branch_;
+    std::string strings_;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdexcept>
+#include <vector>
+#include "snapshot.h"
+
+using namespace std;
+
+/*********************** Messages to use for errors ***************************/
+const std::string SNAPSHOT_INVALID_COMMIT = "Invalid commit number";
+
+// Rebuilt states kept per snapshot before the cache starts over
+const size_t STATE_CACHE_LIMIT = 1u << 16;
+
+Snapshot::Snapshot(const CommitTable& commits, const NameTable& names) :
+    commits_(commits), names_(names)
+{
+}
+
+void Snapshot::refresh(const Snapshot& newer)
+{
+    if (!commits_.same_history(newer.commits_)) states_.clear();
+    commits_ = newer.commits_;
+    names_ = newer.names_;
+}
+
+void Snapshot::check_visible(CommitIdx commit) const
+{
+    if (commit < 0 || commit >= size()) {
+        throw std::invalid_argument(SNAPSHOT_INVALID_COMMIT);
+    }
+}
+
+void Snapshot::log(std::ostream& out, CommitIdx commit, size_t count) const
+{
+    check_visible(commit);
+    for (; commit > 0 && count > 0; commit = commits_.parent(commit), count--) {
+        out << "Commit: " << commit << '\n';
+        out << commits_.message(commit) << "\n\n";
+    }
+}
+
+void Snapshot::display_commit(std::ostream& out, CommitIdx commit) const
+{
+    if (!valid_commit(commit)) {
+        throw std::invalid_argument(SNAPSHOT_INVALID_COMMIT);
+    }
+    write_files(out, names_, commits_.diffs(commit));
+}
+
+void Snapshot::diff(std::ostream& out, CommitIdx from, CommitIdx to) const
+{
+    check_visible(from);
+    check_visible(to);
+    if (commits_.hash(from) == commits_.hash(to)) return;
+    write_files(out, names_, FileTree::diff(state(to), state(from)));
+}
+
+bool Snapshot::value_at(std::string_view filename, CommitIdx commit, int& value) const
+{
+    check_visible(commit);
+    NameId id = names_.find(filename);
+    if (id == NameTable::NO_NAME) return false;
+    FileTree files = state(commit);
+    const int* found = files.find(id);
+    if (found) value = *found;
+    return found != NULL;
+}
+
+FileTree Snapshot::state(CommitIdx commit) const
+{
+    vector<CommitIdx> parents;
+    FileTree files;
+    while (commit > 0) {
+        std::unordered_map<CommitIdx, FileTree>::const_iterator it = states_.find(commit);
+        if (it != states_.end()) {
+            files = it->second;
+            break;
+        }
+        const FileTree* published = commits_.state(commit);
+        if (published) {
+            files = *published;
+            break;
+        }
+        DiffView snapshot = commits_.snapshot(commit);
+        if (!snapshot.empty()) {
+            files.apply(snapshot);
+            break;
+        }
+        parents.push_back(commit);
+        commit = commits_.parent(commit);
+    }
+    if (states_.size() + parents.size() > STATE_CACHE_LIMIT) states_.clear();
+    for (vector<CommitIdx>::reverse_iterator it = parents.rbegin(); it != parents.rend(); ++it) {
+        files.apply(commits_.diffs(*it));
+        states_.emplace(*it, files);
+    }
+    return files;
+}
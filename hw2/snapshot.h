@@ -0,0 +1,93 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <cstddef>
+#include "filestate.h"
+#include "filetree.h"
+#include "committable.h"
+
+/**
+ * Consistent, read-only view of a repository's committed history, taken
+ * with GitInt::snapshot(). It sees exactly the commits that existed when
+ * it was taken, however many are committed afterwards and even if the
+ * repository open()s another pack meanwhile; that can go on in another
+ * thread, since the commit and name tables are append-only and frozen
+ * copies of them never take a lock.
+ *
+ * Each reader thread takes its own Snapshot (O(1)); one Snapshot is not
+ * meant to be shared between threads, since it caches the states it
+ * rebuilds. A reader that wants to see new commits refresh()es its view
+ * rather than starting over, so those states are kept. Queries write in
+ * the same format as the matching GitInt commands.
+ */
+class Snapshot {
+public:
+    Snapshot(const CommitTable& commits, const NameTable& names);
+
+    /**
+     * Moves this view on to `newer`, a later snapshot of the same
+     * repository, keeping the states rebuilt so far (they are dropped if
+     * the repository has open()ed another pack since)
+     */
+    void refresh(const Snapshot& newer);
+
+    /** Number of commits visible, including "init" */
+    CommitIdx size() const {
+        return commits_.size();
+    }
+
+    /** True if the commit is visible and not "init" */
+    bool valid_commit(CommitIdx commit) const {
+        return commit > 0 && commit < size();
+    }
+
+    /**
+     * Writes up to `count` log entries from `commit` back along first
+     * parents
+     *
+     * @throws std::invalid_argument if the commit is not visible
+     */
+    void log(std::ostream& out, CommitIdx commit, size_t count) const;
+
+    /**
+     * Writes the diff stored for a commit
+     *
+     * @throws std::invalid_argument if the commit is not valid
+     */
+    void display_commit(std::ostream& out, CommitIdx commit) const;
+
+    /**
+     * Writes the changes from commit `to` to commit `from`
+     *
+     * @throws std::invalid_argument if either commit is not visible
+     */
+    void diff(std::ostream& out, CommitIdx from, CommitIdx to) const;
+
+    /**
+     * Content of a file at a commit
+     *
+     * @returns false if the file did not exist there
+     * @throws std::invalid_argument if the commit is not visible
+     */
+    bool value_at(std::string_view filename, CommitIdx commit, int& value) const;
+
+private:
+    /**
+     * State of a commit, replayed from the nearest state this snapshot
+     * has already built, one published with the commit table, a pack
+     * snapshot or "init"
+     */
+    FileTree state(CommitIdx commit) const;
+
+    void check_visible(CommitIdx commit) const;
+
+    CommitTable commits_;
+    NameTable names_;
+    // States rebuilt so far; trees share nodes, so each costs only the
+    // nodes its commit changed
+    mutable std::unordered_map<CommitIdx, FileTree> states_;
+};
+
+#endif
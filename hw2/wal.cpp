@@ -0,0 +1,277 @@
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "wal.h"
+#include "pack.h"
+
+using namespace std;
+
+/*********************** Messages to use for errors ***************************/
+const std::string WAL_OPEN_FAILED = "Cannot open log file";
+const std::string WAL_WRITE_FAILED = "Cannot write log file";
+
+namespace {
+
+const char WAL_MAGIC[8] = { 'G', 'I', 'T', 'I', 'N', 'T', 'W', 'L' };
+const size_t WAL_HEADER_BYTES = 16;     // magic + generation
+const size_t RECORD_PREFIX = 8;         // length + crc32
+const size_t RECORD_FIXED = 9;          // type + value
+const size_t WRITE_CHUNK = 64u << 10;   // SYNC_NONE: write out this often
+
+/**
+ * CRC-32 (IEEE 802.3, reflected), table driven
+ */
+struct CrcTable {
+    uint32_t entries_[256];
+
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            entries_[i] = c;
+        }
+    }
+};
+
+uint32_t crc32(const char* data, size_t bytes)
+{
+    static const CrcTable table;
+    uint32_t c = 0xffffffffu;
+    for (size_t i = 0; i < bytes; i++) {
+        c = table.entries_[(c ^ (unsigned char)data[i]) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffffu;
+}
+
+void write_all(int fd, const char* data, size_t bytes)
+{
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, data, bytes);
+        if (n < 0) throw runtime_error(WAL_WRITE_FAILED);
+        data += n;
+        bytes -= n;
+    }
+}
+
+/**
+ * Reads a whole file; false if it does not exist
+ */
+bool read_file(const std::string& path, std::string& out)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    out.clear();
+    char buf[WRITE_CHUNK];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+        out.append(buf, n);
+    }
+    ::close(fd);
+    if (n < 0) throw runtime_error(WAL_OPEN_FAILED);
+    return true;
+}
+
+/**
+ * True if `data` starts with a log header of the given generation
+ */
+bool has_header(std::string_view data, uint64_t generation)
+{
+    uint64_t stored;
+    if (data.size() < WAL_HEADER_BYTES || memcmp(data.data(), WAL_MAGIC, sizeof(WAL_MAGIC)) != 0) {
+        return false;
+    }
+    memcpy(&stored, data.data() + sizeof(WAL_MAGIC), sizeof(stored));
+    return stored == generation;
+}
+
+std::string make_header(uint64_t generation)
+{
+    std::string header(WAL_MAGIC, sizeof(WAL_MAGIC));
+    header.append(reinterpret_cast<const char*>(&generation), sizeof(generation));
+    return header;
+}
+
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& path, uint64_t generation, const WalOptions& options) :
+    path_(path), options_(options), fd_(-1), file_bytes_(0),
+    pending_records_(0), unsynced_(false), next_generation_(0)
+{
+    open_file(generation);
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    try {
+        flush();
+    } catch (std::exception&) {
+        // Nothing left to report to; unsynced records are simply lost
+    }
+    if (fd_ >= 0) ::close(fd_);
+}
+
+void WriteAheadLog::open_file(uint64_t generation)
+{
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) throw runtime_error(WAL_OPEN_FAILED);
+    char header[WAL_HEADER_BYTES];
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && (size_t)st.st_size >= WAL_HEADER_BYTES &&
+            pread(fd_, header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            has_header(std::string_view(header, sizeof(header)), generation)) {
+        file_bytes_ = st.st_size;
+    } else {
+        // Missing or left over from another generation: start afresh
+        std::string fresh = make_header(generation);
+        if (ftruncate(fd_, 0) != 0) throw runtime_error(WAL_WRITE_FAILED);
+        write_all(fd_, fresh.data(), fresh.size());
+        if (fsync(fd_) != 0) throw runtime_error(WAL_WRITE_FAILED);
+        sync_parent_dir(path_);
+        file_bytes_ = fresh.size();
+    }
+    if (lseek(fd_, 0, SEEK_END) < 0) throw runtime_error(WAL_OPEN_FAILED);
+}
+
+size_t WriteAheadLog::replay(const std::string& path, uint64_t generation,
+                             const std::function<void(const Record&)>& apply)
+{
+    std::string data;
+    std::string tmp = path + ".tmp";
+    if (read_file(tmp, data)) {
+        // A checkpoint got as far as writing its pack (whose generation
+        // this is) but not as far as switching logs
+        if (has_header(data, generation)) {
+            if (rename(tmp.c_str(), path.c_str()) != 0) throw runtime_error(WAL_WRITE_FAILED);
+            sync_parent_dir(path);
+        } else {
+            unlink(tmp.c_str());
+        }
+    }
+    if (!read_file(path, data) || !has_header(data, generation)) return 0;
+
+    size_t at = WAL_HEADER_BYTES, count = 0;
+    while (data.size() - at >= RECORD_PREFIX) {
+        uint32_t length, crc;
+        memcpy(&length, data.data() + at, sizeof(length));
+        memcpy(&crc, data.data() + at + sizeof(length), sizeof(crc));
+        const char* body = data.data() + at + RECORD_PREFIX;
+        if (length < RECORD_FIXED || length > data.size() - at - RECORD_PREFIX ||
+                crc32(body, length) != crc) {
+            break;
+        }
+        Record record;
+        record.type_ = (RecordType)(unsigned char)body[0];
+        memcpy(&record.value_, body + 1, sizeof(record.value_));
+        record.text_ = std::string_view(body + RECORD_FIXED, length - RECORD_FIXED);
+        apply(record);
+        count++;
+        at += RECORD_PREFIX + length;
+    }
+    if (at < data.size()) {
+        // Torn tail: drop it so new records follow the last good one
+        int fd = ::open(path.c_str(), O_WRONLY);
+        if (fd < 0 || ftruncate(fd, at) != 0 || fsync(fd) != 0) {
+            if (fd >= 0) ::close(fd);
+            throw runtime_error(WAL_WRITE_FAILED);
+        }
+        ::close(fd);
+    }
+    return count;
+}
+
+void WriteAheadLog::encode(std::string& out, RecordType type, std::string_view text, int64_t value)
+{
+    uint32_t length = RECORD_FIXED + text.size();
+    size_t start = out.size();
+    out.resize(start + RECORD_PREFIX + RECORD_FIXED);
+    char* p = &out[start];
+    memcpy(p, &length, sizeof(length));
+    p[RECORD_PREFIX] = (char)type;
+    memcpy(p + RECORD_PREFIX + 1, &value, sizeof(value));
+    out.append(text.data(), text.size());
+    uint32_t crc = crc32(out.data() + start + RECORD_PREFIX, length);
+    memcpy(&out[start + sizeof(length)], &crc, sizeof(crc));
+}
+
+void WriteAheadLog::append(RecordType type, std::string_view text, int64_t value)
+{
+    encode(pending_, type, text, value);
+    pending_records_++;
+    switch (options_.sync_) {
+    case SYNC_ALWAYS:
+        flush();
+        break;
+    case SYNC_BATCH:
+        // The caller flushes whenever it runs out of queued input, so a
+        // burst of commands shares one fsync; this caps the burst
+        if (pending_records_ >= options_.group_records_) flush();
+        break;
+    case SYNC_NONE:
+        if (pending_.size() >= WRITE_CHUNK) write_pending();
+        break;
+    }
+}
+
+void WriteAheadLog::write_pending()
+{
+    if (pending_.empty()) return;
+    write_all(fd_, pending_.data(), pending_.size());
+    file_bytes_ += pending_.size();
+    pending_.clear();
+    pending_records_ = 0;
+    unsynced_ = true;
+}
+
+void WriteAheadLog::flush()
+{
+    write_pending();
+    if (unsynced_ && options_.sync_ != SYNC_NONE) {
+        if (fdatasync(fd_) != 0) throw runtime_error(WAL_WRITE_FAILED);
+        unsynced_ = false;
+    }
+}
+
+void WriteAheadLog::prepare_reset(uint64_t generation, const std::string& records)
+{
+    // Records still queued are covered by the coming pack, but must be
+    // durable in case the checkpoint does not get that far
+    write_pending();
+    if (fdatasync(fd_) != 0) throw runtime_error(WAL_WRITE_FAILED);
+    unsynced_ = false;
+
+    std::string tmp = path_ + ".tmp";
+    std::string header = make_header(generation);
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw runtime_error(WAL_WRITE_FAILED);
+    try {
+        write_all(fd, header.data(), header.size());
+        write_all(fd, records.data(), records.size());
+        if (fsync(fd) != 0) throw runtime_error(WAL_WRITE_FAILED);
+    } catch (...) {
+        ::close(fd);
+        unlink(tmp.c_str());
+        throw;
+    }
+    ::close(fd);
+    sync_parent_dir(tmp);
+    next_generation_ = generation;
+}
+
+void WriteAheadLog::commit_reset()
+{
+    std::string tmp = path_ + ".tmp";
+    if (rename(tmp.c_str(), path_.c_str()) != 0) throw runtime_error(WAL_WRITE_FAILED);
+    sync_parent_dir(path_);
+    ::close(fd_);
+    fd_ = -1;
+    open_file(next_generation_);
+}
+
+void WriteAheadLog::abort_reset()
+{
+    unlink((path_ + ".tmp").c_str());
+}
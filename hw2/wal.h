@@ -0,0 +1,148 @@
+#ifndef WAL_H
+#define WAL_H
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <functional>
+
+/**
+ * When appended records are forced to stable storage
+ */
+enum SyncPolicy {
+    SYNC_ALWAYS,    // fsync after every record
+    SYNC_BATCH,     // group commit: one fsync per burst of records
+    SYNC_NONE       // write, but leave syncing to the OS
+};
+
+/**
+ * Tuning for the write-ahead log
+ */
+struct WalOptions {
+    SyncPolicy sync_;
+    size_t group_records_;      // SYNC_BATCH: most records per fsync
+    uint64_t checkpoint_bytes_; // log size that triggers a checkpoint
+
+    WalOptions() :
+        sync_(SYNC_BATCH), group_records_(256), checkpoint_bytes_(64u << 20)
+    {}
+};
+
+/**
+ * Append-only log of repository mutations, replayed on top of the last
+ * checkpointed pack after a crash.
+ *
+ * The file starts with a 16-byte header (magic and generation). The
+ * generation must match the one stored in the pack, so a log left over
+ * from before a checkpoint is never replayed twice. Each record is
+ *
+ *   uint32_t length       bytes after the checksum
+ *   uint32_t crc32        of those bytes
+ *   uint8_t  type
+ *   int64_t  value
+ *   char     text[length - 9]
+ *
+ * A record that is cut short or fails its checksum marks the end of the
+ * log: it was never acknowledged, so recovery drops it and everything
+ * after it.
+ */
+class WriteAheadLog {
+public:
+    enum RecordType {
+        CREATE = 1,     // text = filename, value = content
+        EDIT,           // text = filename, value = content
+        ADD,            // text = filename
+        COMMIT,         // text = message
+        TAG,            // text = tag name, value = commit
+        CHECKOUT,       // value = commit
+        BRANCH,         // text = branch name, value = commit
+        SWITCH,         // text = branch name
+        MERGE,          // text = branch name or commit number
+        GC,             // value = squash age, -1 for none
+        CHERRY_PICK,    // value = commit; text = first commit of a range
+        REBASE          // text = "from to onto" (to may be empty)
+    };
+
+    struct Record {
+        RecordType type_;
+        int64_t value_;
+        std::string_view text_;
+    };
+
+    /**
+     * Opens the log at `path` for appending. A missing log, or one of
+     * another generation, is replaced by an empty one.
+     *
+     * @throws std::runtime_error on I/O failure
+     */
+    WriteAheadLog(const std::string& path, uint64_t generation, const WalOptions& options);
+
+    /** Writes and syncs anything still buffered */
+    ~WriteAheadLog();
+
+    /**
+     * Calls `apply` for every intact record of the log at `path` if it
+     * belongs to `generation`, and cuts off any torn tail. Finishes a
+     * checkpoint that was interrupted after its pack was written.
+     *
+     * @returns number of records replayed
+     * @throws std::runtime_error on I/O failure
+     */
+    static size_t replay(const std::string& path, uint64_t generation,
+                         const std::function<void(const Record&)>& apply);
+
+    /**
+     * Appends the encoding of one record to `out`
+     */
+    static void encode(std::string& out, RecordType type, std::string_view text, int64_t value = 0);
+
+    /**
+     * Queues a record; it is written and synced according to the policy
+     *
+     * @throws std::runtime_error on I/O failure
+     */
+    void append(RecordType type, std::string_view text, int64_t value = 0);
+
+    /**
+     * Writes out queued records and, unless the policy is SYNC_NONE,
+     * fsyncs them
+     *
+     * @throws std::runtime_error on I/O failure
+     */
+    void flush();
+
+    /**
+     * Checkpoint support. prepare_reset() durably writes a log of the
+     * next generation holding only `records` next to the current one;
+     * commit_reset() switches to it once the matching pack is in place,
+     * abort_reset() discards it.
+     *
+     * @throws std::runtime_error on I/O failure
+     */
+    void prepare_reset(uint64_t generation, const std::string& records);
+    void commit_reset();
+    void abort_reset();
+
+    /** Bytes in the log, including queued records */
+    uint64_t bytes() const {
+        return file_bytes_ + pending_.size();
+    }
+
+private:
+    WriteAheadLog(const WriteAheadLog&);
+    WriteAheadLog& operator=(const WriteAheadLog&);
+
+    void open_file(uint64_t generation);
+    void write_pending();
+
+    std::string path_;
+    WalOptions options_;
+    int fd_;
+    uint64_t file_bytes_;
+    std::string pending_;       // encoded records not yet written
+    size_t pending_records_;
+    bool unsynced_;             // written but not yet fsynced
+    uint64_t next_generation_;  // of the log staged by prepare_reset()
+};
+
+#endif